@@ -0,0 +1,260 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Avalanche and bit bias analysis.  For random messages of b blocks, each
+// input bit is flipped, and we count how often each output bit flips, which
+// gives a 64x64 matrix per block.  Ideally, every output bit flips with
+// probability 1/2; the later blocks go through fewer update rounds, so we
+// can see how many rounds it takes for the difference to spread.  The output
+// bits themselves are also checked for bias.
+//
+// With -r, the known-good final mixing step is skipped, so the raw update
+// state is studied (for hash2.h, the states are still folded into 64 bits;
+// hash8.h has no final mixing anyway).
+//
+// The flip counts are accumulated with bit-sliced counters: 16 words hold
+// 64 16-bit counters, one per output bit, and adding a difference word is
+// a ripple-carry over the words.  Every 65535 messages the counters are
+// transposed into plain integers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/auxv.h>
+
+static inline uint16_t rotl16(uint16_t x, int k) { return x << k | x >> (16 - k); }
+static inline uint16_t rotr16(uint16_t x, int k) { return x >> k | x << (16 - k); }
+static inline uint32_t rotl32(uint32_t x, int k) { return x << k | x >> (32 - k); }
+static inline uint32_t rotr32(uint32_t x, int k) { return x >> k | x << (32 - k); }
+static inline uint64_t rotl64(uint64_t x, int k) { return x << k | x >> (64 - k); }
+static inline uint64_t rotr64(uint64_t x, int k) { return x >> k | x << (64 - k); }
+
+static bool raw;
+
+// A known-good mixing step, by Pelle Evensen.
+static inline uint64_t rrmxmx(uint64_t x)
+{
+    if (raw)
+	return x;
+    x ^= rotr64(x, 49) ^ rotr64(x, 24);
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    return x;
+}
+
+#include INC // e.g. "hash1.h" the original construction
+
+#ifndef MINLEN
+#define MINLEN 1
+#endif
+
+static __uint128_t rand64state;
+
+static __attribute__((constructor)) void rand64init(void)
+{
+    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
+    rand64state |= 1;
+}
+
+static inline uint64_t rand64(void)
+{
+    uint64_t ret = rand64state >> 64;
+    rand64state *= 0xda942042e4dd58b5;
+    return ret;
+}
+
+// Rows 0..64*blocks-1 count the flips for each input bit, the last row
+// counts the ones in the output.
+static struct {
+    int blocks;
+    int nrow;
+    uint64_t nmsg;
+    uint64_t seed;
+    int nthr;
+    pthread_mutex_t mutex;
+    uint64_t (*cnt)[64];
+} G;
+
+// The messages are derived from the seed and the message index with
+// the SplitMix64 finalizer, so the results do not depend on the thread count.
+static inline uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+static inline void vadd(uint64_t c[16], uint64_t d)
+{
+    for (int k = 0; k < 16 && d; k++) {
+	uint64_t t = c[k] & d;
+	c[k] ^= d;
+	d = t;
+    }
+}
+
+static void flush(uint64_t c[][16], uint64_t cnt[][64])
+{
+    for (int i = 0; i < G.nrow; i++) {
+	for (int j = 0; j < 64; j++) {
+	    uint64_t n = 0;
+	    for (int k = 0; k < 16; k++)
+		n |= (c[i][k] >> j & 1) << k;
+	    cnt[i][j] += n;
+	}
+	memset(c[i], 0, sizeof c[i]);
+    }
+}
+
+void *worker(void *arg)
+{
+    int t = (intptr_t) arg;
+    uint64_t lo = G.nmsg * t / G.nthr;
+    uint64_t hi = G.nmsg * (t + 1) / G.nthr;
+    uint64_t (*c)[16] = calloc(G.nrow, sizeof *c);
+    uint64_t (*cnt)[64] = calloc(G.nrow, sizeof *cnt);
+    assert(c && cnt);
+    size_t len = 8 * G.blocks;
+    uint64_t m[64];
+    assert(G.blocks <= 64);
+    for (uint64_t i = lo; i < hi; i++) {
+	for (int b = 0; b < G.blocks; b++)
+	    m[b] = mix(G.seed + 64 * i + b);
+	uint64_t h0 = hash((void *) m, len, G.seed);
+	vadd(c[G.nrow-1], h0);
+	for (int b = 0; b < G.blocks; b++)
+	    for (int bit = 0; bit < 64; bit++) {
+		m[b] ^= UINT64_C(1) << bit;
+		vadd(c[64*b+bit], h0 ^ hash((void *) m, len, G.seed));
+		m[b] ^= UINT64_C(1) << bit;
+	    }
+	if ((i - lo) % 65535 == 65534)
+	    flush(c, cnt);
+    }
+    flush(c, cnt);
+    int rc = pthread_mutex_lock(&G.mutex);
+    assert(rc == 0);
+    for (int i = 0; i < G.nrow; i++)
+	for (int j = 0; j < 64; j++)
+	    G.cnt[i][j] += cnt[i][j];
+    rc = pthread_mutex_unlock(&G.mutex);
+    assert(rc == 0);
+    free(c);
+    free(cnt);
+    return arg;
+}
+
+int main(int argc, char **argv)
+{
+    G.nthr = 2;
+    G.seed = rand64();
+    G.nmsg = 1 << 20;
+    int maxblocks = 4;
+    bool matrix = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:b:rm")) != -1)
+    switch (opt) {
+    case 'j':
+	G.nthr = atoi(optarg);
+	assert(G.nthr > 0);
+	break;
+    case 's':
+	G.seed = strtoull(optarg, NULL, 16);
+	break;
+    case 'b':
+	maxblocks = atoi(optarg);
+	assert(maxblocks > 0 && maxblocks <= 64);
+	break;
+    case 'r':
+	raw = true;
+	break;
+    case 'm':
+	matrix = true;
+	break;
+    default:
+	assert(!!!"getopt");
+    }
+    if (optind < argc) {
+	assert(optind + 1 == argc);
+	G.nmsg = strtoull(argv[optind], NULL, 0);
+	assert(G.nmsg > 0);
+    }
+
+    pthread_mutex_init(&G.mutex, NULL);
+    pthread_t *tid = malloc(G.nthr * sizeof *tid);
+    assert(tid);
+    for (int blocks = (MINLEN + 7) / 8; blocks <= maxblocks; blocks++) {
+	G.blocks = blocks;
+	G.nrow = 64 * blocks + 1;
+	G.cnt = calloc(G.nrow, sizeof *G.cnt);
+	assert(G.cnt);
+	for (int i = 0; i < G.nthr; i++) {
+	    int rc = pthread_create(&tid[i], NULL, worker, (void *)(intptr_t) i);
+	    assert(rc == 0);
+	}
+	for (int i = 0; i < G.nthr; i++) {
+	    int rc = pthread_join(tid[i], NULL);
+	    assert(rc == 0);
+	}
+	// For a fair coin, (n - N/2)^2 / (N/4) is chi-square with 1 dof.
+	// The input bits are numbered within the block.
+	double N = G.nmsg;
+	FILE *fp = matrix ? stderr : stdout;
+	for (int b = 0; b < blocks; b++) {
+	    double chi2 = 0, worst = 0, sum = 0;
+	    int wi = 0, wj = 0;
+	    for (int i = 0; i < 64; i++)
+		for (int j = 0; j < 64; j++) {
+		    uint64_t n = G.cnt[64*b+i][j];
+		    double p = n / N;
+		    double d = fabs(p - 0.5);
+		    chi2 += (n - N / 2) * (n - N / 2) / (N / 4);
+		    sum += d;
+		    if (d > worst)
+			worst = d, wi = i, wj = j;
+		    if (matrix)
+			printf("%d\t%d\t%d\t%d\t%.6f\n", blocks, b, i, j, p);
+		}
+	    fprintf(fp, "blocks=%d block=%d avalanche worst %.5f (in %d out %d)"
+		    " mean %.5f chi2/dof %.3f\n",
+		    blocks, b, worst, wi, wj, sum / 4096, chi2 / 4096);
+	}
+	double oworst = 0;
+	int oj = 0;
+	for (int j = 0; j < 64; j++) {
+	    double d = fabs(G.cnt[G.nrow-1][j] / N - 0.5);
+	    if (d > oworst)
+		oworst = d, oj = j;
+	}
+	fprintf(fp, "blocks=%d output bias worst %.5f (bit %d)\n", blocks, oworst, oj);
+	free(G.cnt);
+    }
+    free(tid);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#!/bin/sh
+# End-to-end benchmark of collisions.c: fixed-seed trials of each construction
+# on generated corpora of several sizes, with several thread counts.
+#
+# The results go to bench.tsv: trials/s, strings/s, peak RSS (KB), and the
+# split between the phases (in thread-seconds, from collisions.c -v).  The
+# digest column is a checksum of the collision lines, which must not depend
+# on the thread count, nor change when the code is optimised.  The corpora
+# are too small for 64-bit collisions, so the hash values are truncated to
+# the top BITS bits, which gives about n^2/2^(BITS+1) collisions per trial.
+#
+# If bench.baseline exists (e.g. a bench.tsv from an earlier run), each row
+# is checked against it: the digest must match, and trials/s must not drop
+# by more than THRESHOLD percent.  The exit status is 1 if any check fails.
+#
+# Everything can be overridden from the environment, e.g.
+#	SIZES="1000000" THREADS="1 4" ./bench.sh
+# The default sizes fit in ordinary RAM.  The 100M corpus is opt-in: it
+# needs about 2.4G of hash entries per thread, and comes close to the 4G
+# limit of the slab.
+
+set -efu
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -march=native}
+HASHES=${HASHES:-"hash1 hash2 hash8 zrha64"}
+BITS=${BITS:-36}
+SIZES=${SIZES:-"1000000 10000000"}
+THREADS=${THREADS:-}
+GEN=${GEN:-mangled}
+TRIALS=${TRIALS:-8}
+SEED=${SEED:-5eed}
+OUT=${OUT:-bench.tsv}
+BASELINE=${BASELINE:-bench.baseline}
+THRESHOLD=${THRESHOLD:-10}
+
+# By default, as many threads as there are CPUs, but no more than fit into
+# half of the available memory: each thread takes 24 bytes per string for
+# the hash entries, and the slab takes about 64 bytes per string.
+if [ -z "$THREADS" ]; then
+    maxn=0
+    for n in $SIZES; do
+	[ "$n" -le "$maxn" ] || maxn=$n
+    done
+    avail=$(awk '/^MemAvailable:/ { printf "%.0f\n", $2 * 1024 }' /proc/meminfo 2>/dev/null || :)
+    j=$(nproc)
+    if [ -n "$avail" ]; then
+	fit=$(( (avail / 2 - 64 * maxn) / (24 * maxn) ))
+	[ "$fit" -ge 1 ] || fit=1
+	[ "$j" -le "$fit" ] || j=$fit
+    fi
+    THREADS=1
+    [ "$j" -eq 1 ] || THREADS="1 $j"
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+printf 'hash\tsize\tthreads\ttrials/s\tstrings/s\trss\tload\thash\tsort\tscan\tdigest\n' >"$OUT"
+for h in $HASHES; do
+    cat >"$tmp/$h-trunc.h" <<EOF
+#define hash hash64
+#include "$h.h"
+#undef hash
+static inline uint64_t hash(const void *data, size_t len, uint64_t seed)
+{
+    return hash64(data, len, seed) & ~(UINT64_MAX >> $BITS);
+}
+EOF
+    $CC $CFLAGS -I. -DINC="\"$tmp/$h-trunc.h\"" -o "$tmp/$h" \
+	collisions.c slab.c numa.c shard.c pairmap.c gen.c zload.c -lpthread -lm
+    for n in $SIZES; do
+	for j in $THREADS; do
+	    ntry=$TRIALS
+	    [ "$ntry" -ge "$j" ] || ntry=$j
+	    "$tmp/$h" -v -j "$j" -s "$SEED" -g "$GEN:$n:1" "$ntry" >"$tmp/out" 2>"$tmp/err"
+	    [ -s "$tmp/out" ] ||
+		echo "$h $n -j$j: no collision lines to check, try a smaller BITS" >&2
+	    digest=$(sort "$tmp/out" | md5sum | cut -c1-16)
+	    grep '^# time ' "$tmp/err" |
+	    awk -v h="$h" -v n="$n" -v j="$j" -v digest="$digest" '{
+		for (i = 3; i <= NF; i++) {
+		    split($i, kv, "=")
+		    v[kv[1]] = kv[2]
+		}
+		printf "%s\t%s\t%s\t%.3f\t%.0f\t%s\t%s\t%s\t%s\t%s\t%s\n", h, n, j,
+		    v["trials"] / v["run"], v["trials"] * v["strings"] / v["run"],
+		    v["rss"], v["load"], v["hash"], v["sort"], v["scan"], digest
+	    }' | tee -a "$OUT"
+	done
+    done
+done
+
+# The digest must be the same for all thread counts.
+status=0
+awk -F'\t' 'NR > 1 {
+    key = $1 "\t" $2
+    if (key in d && d[key] != $11) {
+	printf "%s %s: digest depends on the thread count\n", $1, $2
+	bad = 1
+    }
+    d[key] = $11
+} END { exit bad }' "$OUT" || status=1
+
+if [ -f "$BASELINE" ]; then
+    awk -F'\t' -v t="$THRESHOLD" '
+    FNR == 1 { next }
+    NR == FNR { base[$1 "\t" $2 "\t" $3] = $4; dig[$1 "\t" $2 "\t" $3] = $11; next }
+    {
+	key = $1 "\t" $2 "\t" $3
+	if (!(key in base))
+	    next
+	if ($11 != dig[key]) {
+	    printf "%s %s -j%s: collision lines differ from the baseline\n", $1, $2, $3
+	    bad = 1
+	}
+	change = ($4 / base[key] - 1) * 100
+	printf "%s %s -j%s: %.3f trials/s, %+.1f%% vs baseline\n", $1, $2, $3, $4, change
+	if (change < -t) {
+	    printf "%s %s -j%s: regression beyond %s%%\n", $1, $2, $3, t
+	    bad = 1
+	}
+    } END { exit bad }' "$BASELINE" "$OUT" || status=1
+fi
+exit $status
@@ -23,9 +23,17 @@
 #include <inttypes.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <math.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <sys/auxv.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 static inline uint16_t rotl16(uint16_t x, int k) { return x << k | x >> (16 - k); }
 static inline uint16_t rotr16(uint16_t x, int k) { return x >> k | x << (16 - k); }
@@ -52,6 +60,12 @@ static inline uint64_t rrmxmx(uint64_t x)
 #endif
 
 #include "slab.h"
+#include "numa.h"
+#include "shard.h"
+#include "pairmap.h"
+#include "zload.h"
+#include "gen.h"
+#include "falter.h"
 
 // To detect collisions, these "hash entries" are sorted.
 #pragma pack(push, 4)
@@ -62,7 +76,11 @@ struct he {
 #pragma pack(pop)
 static_assert(sizeof(struct he) == 12, "");
 
-void hsort(struct he *hv, size_t n)
+// Optionally, while sorting, counts the pairs which agree on the low bits:
+// low[D] for the low D bytes, D = 1..7.  LSD radix passes get the entries
+// ordered by the low D bytes just before the D-th pass, so counting is fused
+// into that pass.  The padding entry is recognized by its zero slab offset.
+void hsort(struct he *hv, size_t n, uint64_t low[8])
 {
     if (n & 1)
 	hv[n++] = (struct he) { UINT64_MAX, 0 };
@@ -109,21 +127,160 @@ void hsort(struct he *hv, size_t n)
 	W[j0] = e0;						\
 	W[j1] = e1;						\
     }
+#define RadixCount(e)						\
+    if (likely(e.so)) {						\
+	uint64_t x = e.h & mask;				\
+	if (x == prev)						\
+	    pairs += ++run;					\
+	else							\
+	    prev = x, run = 0;					\
+    }
+#define RadixLoopCount(D, V, W)					\
+    {								\
+	uint64_t mask = UINT64_MAX >> (64 - D*8);		\
+	uint64_t prev = UINT64_MAX, run = 0, pairs = 0;		\
+	for (size_t i = 0; i < n; i += 2) {			\
+	    struct he e0 = V[i+0];				\
+	    struct he e1 = V[i+1];				\
+	    RadixCount(e0)					\
+	    RadixCount(e1)					\
+	    size_t j0 = d[D][(uint8_t)(e0.h >> D*8)]++;		\
+	    size_t j1 = d[D][(uint8_t)(e1.h >> D*8)]++;		\
+	    W[j0] = e0;						\
+	    W[j1] = e1;						\
+	}							\
+	low[D] = pairs;						\
+    }
+#define RadixPass(D, V, W)					\
+    if (low)							\
+	RadixLoopCount(D, V, W)					\
+    else							\
+	RadixLoop(D, V, W)
     RadixLoop(0, hv, hw)
-    RadixLoop(1, hw, hv)
-    RadixLoop(2, hv, hw)
-    RadixLoop(3, hw, hv)
-    RadixLoop(4, hv, hw)
-    RadixLoop(5, hw, hv)
-    RadixLoop(6, hv, hw)
-    RadixLoop(7, hw, hv)
+    RadixPass(1, hw, hv)
+    RadixPass(2, hv, hw)
+    RadixPass(3, hw, hv)
+    RadixPass(4, hv, hw)
+    RadixPass(5, hw, hv)
+    RadixPass(6, hv, hw)
+    RadixPass(7, hw, hv)
 }
 
-// A single try: hash all strings on the slab (with a particular seed)
-// and check if there are collisions.
-void try(const struct slab *slab, size_t n, uint64_t seed, struct he *hv)
+static __uint128_t rand64state;
+
+static __attribute__((constructor)) void rand64init(void)
 {
-    uint32_t so = 3;
+    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
+    rand64state |= 1;
+}
+
+static inline uint64_t rand64(void)
+{
+    uint64_t ret = rand64state >> 64;
+    rand64state *= 0xda942042e4dd58b5;
+    return ret;
+}
+
+static struct {
+    struct slab slab;
+    uint32_t nstr;
+    pthread_mutex_t mutex;
+    int ntry;
+    int nthr;
+    // Trial indices to run, [next, end).  With a campaign seed, the seed
+    // for each trial is derived from its index; otherwise seeds are random.
+    uint64_t next, end;
+    uint64_t seed0;
+    bool seeded;
+    // In the worker mode, ranges come from the coordinator,
+    // and the results go back to it.
+    FILE *in, *out;
+    struct batch *batch;
+    bool eof;
+    bool pipe;
+    // NUMA placement: threads are pinned, and each node gets its own
+    // read-only copy of the slab.
+    bool numa;
+    int huge;
+    struct numa topo;
+    struct slab *replica;
+    int *order; // topo indices, in the order the threads take them
+    int norder;
+    // Near-collision statistics on the top and low k bits.
+    int nk;
+    int k[8];
+    // Pairs which collide under many seeds.  In the worker mode, the counts
+    // are sent to the coordinator, which has the strings too.
+    uint32_t rmin;
+    int logpairs;
+    struct pairmap pairs;
+    // In the incremental mode, the sorted hash entries for each seed are
+    // kept in this directory.  The strings past the stored runs are new.
+    const char *incdir;
+    uint32_t fill; // the end of the strings, before the padding
+    uint64_t sum;  // the checksum of the strings
+    uint32_t oldfill;
+    uint64_t oldsum;
+    // The sweep: the colliding pairs are also counted within the nested
+    // subsets of these sizes, either the first strings or by a random rank.
+    int nsweep;
+    uint32_t sweep[16];
+    uint64_t swpairs[16];
+    uint32_t *offs; // the slab offset of each string
+    uint32_t *rank; // NULL for the prefix subsets
+    bool swrandom;
+    // The filter on the top fbits of the hash values: for each bucket, one
+    // bit says it is taken, and another that it is taken more than once.
+    // Only the entries in the latter buckets can collide.
+    int fbits; // -1 to size it by the number of strings
+    size_t fsize; // in bytes
+    uint64_t nskip; // the trials with no candidates, hence no sort
+    // Time spent in each phase, summed over the threads, in nanoseconds.
+    uint64_t ns[3];
+    uint64_t ntrial;
+    bool verbose;
+} G;
+
+enum { T_HASH, T_SORT, T_SCAN };
+
+static inline uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static inline void account(int phase, uint64_t t0, uint64_t t1)
+{
+    __atomic_add_fetch(&G.ns[phase], t1 - t0, __ATOMIC_RELAXED);
+}
+
+// A range of trials obtained from the coordinator.
+struct batch {
+    uint64_t lo, hi;
+    uint64_t left;
+};
+
+struct trial {
+    uint64_t idx;
+    uint64_t seed;
+    struct batch *batch; // NULL unless in the worker mode
+#ifdef FALTER
+    struct falter falter; // counted by the thread which did the hashing
+#endif
+};
+
+// Hash n strings on the slab, starting at offset so (3 for all strings),
+// with a particular seed.  This stage is compute-bound, and can run
+// alongside a sort on another thread.  The filter, unless NULL, is filled
+// along the way.  The two bits of a bucket are in adjacent words.
+void hash_all(const struct slab *slab, uint32_t so, size_t n, uint64_t seed, struct he *hv,
+	uint64_t *filt)
+{
+    uint64_t t0 = now();
+    FALTER_RESET();
+    if (filt)
+	memset(filt, 0, G.fsize);
     const char *s;
     uint16_t len;
     for (size_t i = 0; i < n; i++) {
@@ -132,8 +289,93 @@ void try(const struct slab *slab, size_t n, uint64_t seed, struct he *hv)
 	uint64_t h = hash(s, len, seed);
 	hv[i] = (struct he){ h, so };
 	so += len + 2;
+	if (filt) {
+	    uint64_t b = h >> (64 - G.fbits);
+	    uint64_t m = UINT64_C(1) << (b & 63);
+	    uint64_t *w = &filt[2*(b>>6)];
+	    w[1] |= w[0] & m;
+	    w[0] |= m;
+	}
     }
-    hsort(hv, n);
+    account(T_HASH, t0, now());
+}
+
+// In the worker mode, the lines are tagged with the range of the trial.
+static void print_prefix(const struct trial *t)
+{
+    if (t->batch)
+	fprintf(G.out, "C %" PRIu64 " ", t->batch->lo);
+}
+
+// Counts the pairs which agree on the top k bits, for each k, and reports
+// them along with the pairs which agree on the low k bits.  For a random
+// function, each count is about Poisson with the mean C(n,2)/2^k.
+static void nearstats(size_t n, const struct trial *t, const struct he *hv, const uint64_t low[8])
+{
+    uint64_t top[8] = { 0, }, run[8] = { 0, };
+    for (size_t i = 1; i < n; i++) {
+	uint64_t x = hv[i-1].h ^ hv[i].h;
+	int p = x ? __builtin_clzll(x) : 64;
+	for (int j = 0; j < G.nk; j++)
+	    if (p >= G.k[j])
+		top[j] += ++run[j];
+	    else
+		run[j] = 0;
+    }
+    flockfile(G.out);
+    for (int j = 0; j < G.nk; j++) {
+	int k = G.k[j];
+	double e = ldexp(n * (n - 1.0) / 2, -k);
+	print_prefix(t);
+	fprintf(G.out, "# %016" PRIx64 " k=%d top %" PRIu64 " %.1f %+.2f",
+		t->seed, k, top[j], e, (top[j] - e) / sqrt(e));
+	if (k % 8 == 0 && k < 64)
+	    fprintf(G.out, " low %" PRIu64 " %.1f %+.2f",
+		    low[k/8], e, (low[k/8] - e) / sqrt(e));
+	fputc('\n', G.out);
+    }
+    funlockfile(G.out);
+}
+
+// Maps the slab offset to the string index.
+static inline uint32_t str_index(uint32_t so)
+{
+    uint32_t lo = 0, hi = G.nstr;
+    while (lo + 1 < hi) {
+	uint32_t mid = (lo + hi) / 2;
+	if (G.offs[mid] <= so)
+	    lo = mid;
+	else
+	    hi = mid;
+    }
+    assert(G.offs[lo] == so);
+    return lo;
+}
+
+// Counts the pairs of the group within each subset.
+static void sweep_group(const struct he *g, const struct he *end)
+{
+    uint64_t cnt[16] = { 0, };
+    for (const struct he *e = g; e < end; e++) {
+	uint32_t i = str_index(e->so);
+	uint32_t r = G.rank ? G.rank[i] : i;
+	for (int k = 0; k < G.nsweep; k++)
+	    cnt[k] += r < G.sweep[k];
+    }
+    for (int k = 0; k < G.nsweep; k++)
+	if (cnt[k] > 1)
+	    __atomic_add_fetch(&G.swpairs[k], cnt[k] * (cnt[k] - 1) / 2, __ATOMIC_RELAXED);
+}
+
+// Reports the groups of sorted entries with the same hash value, but only
+// those groups with a string at or past the offset newso (0 for all groups).
+// Returns the number of reported strings.
+static size_t scan(const struct slab *slab, size_t n, const struct trial *t, struct he *hv,
+	uint32_t newso)
+{
+    const char *s;
+    uint16_t len;
+    size_t ncoll = 0;
     hv[n] = (struct he) { ~hv[n-1].h, 0 }; // sentinel
     for (struct he *he = hv + 1, *hend = hv + n; he < hend; ) {
 	uint64_t h = he[-1].h;
@@ -141,76 +383,799 @@ void try(const struct slab *slab, size_t n, uint64_t seed, struct he *hv)
 	    he++;
 	    continue;
 	}
-	flockfile(stdout);
-	s = slab_get(slab, he[-1].so);
-	memcpy(&len, s - 2, 2);
-	printf("%016" PRIx64 " %016" PRIx64 " %.*s\n", seed, h, len, s);
+	struct he *g = --he;
+	if (newso) {
+	    bool fresh = false;
+	    do
+		fresh |= he->so >= newso, he++;
+	    while (h == he->h);
+	    if (!fresh)
+		continue;
+	    he = g;
+	}
+	flockfile(G.out);
 	do {
 	    s = slab_get(slab, he->so);
 	    memcpy(&len, s - 2, 2);
-	    printf("%016" PRIx64 " %016" PRIx64 " %.*s\n", seed, h, len, s);
+	    print_prefix(t);
+	    // The strings may contain zero bytes.
+	    fprintf(G.out, "%016" PRIx64 " %016" PRIx64 " ", t->seed, h);
+	    fwrite(s, 1, len, G.out);
+	    putc('\n', G.out);
+	    ncoll++;
 	    he++;
 	} while (h == he->h);
-	funlockfile(stdout);
+	funlockfile(G.out);
+	if (G.nsweep)
+	    sweep_group(g, he);
+	// Pathologically big groups are not tracked, the pairs would
+	// only flood the map.
+	if (G.rmin && he - g <= 32)
+	    for (struct he *e1 = g; e1 < he; e1++)
+		for (struct he *e2 = e1 + 1; e2 < he; e2++)
+		    pairmap_add(&G.pairs, e1->so, e2->so);
     }
+    return ncoll;
 }
 
-static __uint128_t rand64state;
+// Moves the entries which may collide, according to the filter, to the
+// front; returns their number.
+static size_t gather(struct he *hv, size_t n, const uint64_t *filt)
+{
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+	uint64_t b = hv[i].h >> (64 - G.fbits);
+	hv[j] = hv[i];
+	j += filt[2*(b>>6)+1] >> (b & 63) & 1;
+    }
+    return j;
+}
 
-static __attribute__((constructor)) void rand64init(void)
+// Sort the hash entries and check if there are collisions.  This stage
+// is mostly memory-bound.  Returns the number of colliding strings.
+// With the filter, only the candidates get sorted, and most trials
+// need no sort at all.
+size_t check(const struct slab *slab, size_t n, const struct trial *t, struct he *hv,
+	const uint64_t *filt)
 {
-    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
-    rand64state |= 1;
+    uint64_t low[8];
+    uint64_t t0 = now();
+    if (filt && (n = gather(hv, n, filt)) == 0) {
+	__atomic_add_fetch(&G.nskip, 1, __ATOMIC_RELAXED);
+	account(T_SORT, t0, now());
+	return 0;
+    }
+    hsort(hv, n, G.nk ? low : NULL);
+    uint64_t t1 = now();
+    account(T_SORT, t0, t1);
+    if (G.nk)
+	nearstats(n, t, hv, low);
+    size_t ncoll = scan(slab, n, t, hv, 0);
+    account(T_SCAN, t1, now());
+    return ncoll;
 }
 
-static inline uint64_t rand64(void)
+// A single try: hash all strings on the slab (with a particular seed)
+// and check if there are collisions.
+size_t try(const struct slab *slab, size_t n, struct trial *t, struct he *hv, uint64_t *filt)
 {
-    uint64_t ret = rand64state >> 64;
-    rand64state *= 0xda942042e4dd58b5;
-    return ret;
+    hash_all(slab, 3, n, t->seed, hv, filt);
+    FALTER_SAVE(t->falter);
+    return check(slab, n, t, hv, filt);
 }
 
-static struct {
-    struct slab slab;
+// In the incremental mode, a run file holds the sorted hash entries
+// of the first nstr strings, which end at the slab offset fill.
+struct runhdr {
+    char magic[8];
+    uint64_t seed;
+    uint64_t probe; // tells the hash constructions apart
+    uint64_t sum;   // the checksum of the slab up to fill
     uint32_t nstr;
-    pthread_mutex_t mutex;
-    int ntry;
-    int nthr;
-} G;
+    uint32_t fill;
+};
+
+#define RUNMAGIC "collrun1"
+
+static uint64_t slab_sum(const struct slab *slab, uint32_t fill)
+{
+    uint64_t sum = fill, w;
+    uint32_t i;
+    for (i = 0; i + 8 <= fill; i += 8) {
+	memcpy(&w, slab->base + i, 8);
+	sum = rotl64((sum ^ w) * UINT64_C(0x9FB21C651E98DF25), 31);
+    }
+    w = 0;
+    memcpy(&w, slab->base + i, fill - i);
+    return rrmxmx(sum ^ w);
+}
+
+// The checksum of the old strings, usually the same for all runs.
+static uint64_t old_sum(const struct slab *slab, uint32_t fill)
+{
+    int rc = pthread_mutex_lock(&G.mutex);
+    assert(rc == 0);
+    if (G.oldfill != fill) {
+	G.oldsum = slab_sum(slab, fill);
+	G.oldfill = fill;
+    }
+    uint64_t sum = G.oldsum;
+    rc = pthread_mutex_unlock(&G.mutex);
+    assert(rc == 0);
+    return sum;
+}
+
+static inline uint64_t probe(uint64_t seed)
+{
+    static const char s[] = "collisions.c incremental run";
+    return hash(s, sizeof s - 1, seed);
+}
+
+static void run_path(char *path, size_t size, uint64_t seed, const char *prefix)
+{
+    int rc = snprintf(path, size, "%s/%s%016" PRIx64 ".run", G.incdir, prefix, seed);
+    assert(rc > 0 && (size_t) rc < size);
+}
+
+// Maps the stored run for the seed.  Returns NULL if there is none,
+// or if it does not match the corpus (then the seed starts over).
+static const struct runhdr *run_map(const struct slab *slab, uint64_t seed, size_t *mapsize)
+{
+    char path[4096];
+    run_path(path, sizeof path, seed, "");
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	assert(errno == ENOENT);
+	return NULL;
+    }
+    struct stat st;
+    int rc = fstat(fd, &st);
+    assert(rc == 0);
+    if ((size_t) st.st_size < sizeof(struct runhdr)) {
+	fprintf(stderr, "%s: truncated, starting over\n", path);
+	close(fd);
+	return NULL;
+    }
+    const struct runhdr *r = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert(r != MAP_FAILED);
+    close(fd);
+    const char *why = NULL;
+    if (memcmp(r->magic, RUNMAGIC, 8))
+	why = "bad magic";
+    else if (r->seed != seed || r->probe != probe(seed))
+	why = "different hash";
+    else if ((size_t) st.st_size != sizeof *r + r->nstr * sizeof(struct he))
+	why = "bad size";
+    else if (r->nstr > G.nstr || r->fill > G.fill)
+	why = "more strings than in the corpus";
+    else if (r->sum != old_sum(slab, r->fill))
+	why = "the corpus has changed";
+    if (why) {
+	fprintf(stderr, "%s: %s, starting over\n", path, why);
+	munmap((void *) r, st.st_size);
+	return NULL;
+    }
+    madvise((void *) r, st.st_size, MADV_SEQUENTIAL);
+    *mapsize = st.st_size;
+    return r;
+}
+
+static void xwrite(int fd, const void *buf, size_t size)
+{
+    while (size) {
+	ssize_t n = write(fd, buf, size);
+	assert(n > 0);
+	buf += n, size -= n;
+    }
+}
+
+// Stores the run, atomically replacing the old one.
+static void run_write(uint64_t seed, const struct he *hv, size_t n)
+{
+    char path[4096], tmp[4096];
+    run_path(path, sizeof path, seed, "");
+    run_path(tmp, sizeof tmp, seed, ".");
+    struct runhdr r = { RUNMAGIC, seed, probe(seed), G.sum, n, G.fill };
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    xwrite(fd, &r, sizeof r);
+    xwrite(fd, hv, n * sizeof *hv);
+    int rc = fsync(fd);
+    assert(rc == 0);
+    close(fd);
+    rc = rename(tmp, path);
+    assert(rc == 0);
+}
+
+// The incremental try: only the new strings are hashed and sorted, and then
+// merged with the stored run; only the groups with a new string are reported.
+// The merged run is stored for the next time.
+static size_t try_inc(const struct slab *slab, struct trial *t, struct he *hv)
+{
+    size_t mapsize;
+    const struct runhdr *r = run_map(slab, t->seed, &mapsize);
+    if (!r) {
+	size_t ncoll = try(slab, G.nstr, t, hv, NULL);
+	run_write(t->seed, hv, G.nstr);
+	return ncoll;
+    }
+    size_t n0 = r->nstr, m = G.nstr - n0;
+    if (m == 0) {
+	munmap((void *) r, mapsize);
+	return 0;
+    }
+    const struct he *old = (const void *)(r + 1);
+    struct he *nv = malloc(2 * (m + 1) * sizeof *nv);
+    assert(nv);
+    hash_all(slab, r->fill + 2, m, t->seed, nv, NULL);
+    FALTER_SAVE(t->falter);
+    uint64_t t0 = now();
+    hsort(nv, m, NULL);
+    size_t i = 0, j = 0, k = 0;
+    while (i < n0 && j < m)
+	hv[k++] = old[i].h <= nv[j].h ? old[i++] : nv[j++];
+    memcpy(hv + k, old + i, (n0 - i) * sizeof *hv), k += n0 - i;
+    memcpy(hv + k, nv + j, (m - j) * sizeof *hv);
+    uint64_t t1 = now();
+    account(T_SORT, t0, t1);
+    size_t ncoll = scan(slab, G.nstr, t, hv, r->fill + 2);
+    account(T_SCAN, t1, now());
+    free(nv);
+    munmap((void *) r, mapsize);
+    run_write(t->seed, hv, G.nstr);
+    return ncoll;
+}
+
+static void sweep_rank(uint64_t seed);
+
+// Gets the next range from the coordinator; called under the mutex.
+static bool fetch(void)
+{
+    if (G.eof)
+	return false;
+    // The coordinator may be gone, which means there is no more work.
+    fputs("G\n", G.out);
+    if (fflush(G.out) != 0) {
+	G.eof = true;
+	return false;
+    }
+    char line[128];
+    uint64_t lo, hi;
+    if (!fgets(line, sizeof line, G.in) || *line == 'E') {
+	G.eof = true;
+	return false;
+    }
+    int rc = sscanf(line, "R %" SCNu64 " %" SCNu64 " %" SCNx64, &lo, &hi, &G.seed0);
+    assert(rc == 3 && lo < hi);
+    G.batch = malloc(sizeof *G.batch);
+    assert(G.batch);
+    *G.batch = (struct batch) { lo, hi, hi - lo };
+    G.next = lo, G.end = hi;
+    G.seeded = true;
+    // The random subsets are ranked by the campaign seed, the same way
+    // in all workers.
+    if (G.swrandom && !G.rank)
+	sweep_rank(G.seed0);
+    return true;
+}
+
+// Takes the next trial, returns false when there are no more tries.
+static bool next_trial(struct trial *t)
+{
+    // lock
+    int rc = pthread_mutex_lock(&G.mutex);
+    assert(rc == 0);
+    // critical
+    bool more = G.next < G.end || (G.in && fetch());
+    if (more) {
+	t->idx = G.next++;
+	G.ntrial++;
+	t->seed = G.seeded ? rrmxmx(G.seed0 + t->idx) : rand64();
+	t->batch = G.batch;
+    }
+    // unlock
+    rc = pthread_mutex_unlock(&G.mutex);
+    assert(rc == 0);
+    return more;
+}
+
+// Reports the trial back to the coordinator.
+static void trial_done(const struct trial *t, size_t ncoll)
+{
+#ifdef FALTER
+    flockfile(G.out);
+    print_prefix(t);
+    fprintf(G.out, "# %016" PRIx64 " falter ncoll %zu", t->seed, ncoll);
+    falter_print(G.out, &t->falter);
+    putc('\n', G.out);
+    funlockfile(G.out);
+#endif
+    struct batch *b = t->batch;
+    if (!b)
+	return;
+    fprintf(G.out, "T %" PRIu64 " %" PRIu64 " %zu\n", b->lo, t->idx, ncoll);
+    if (__atomic_sub_fetch(&b->left, 1, __ATOMIC_ACQ_REL) == 0) {
+	fprintf(G.out, "D %" PRIu64 "\n", b->lo);
+	fflush(G.out);
+	free(b);
+    }
+}
+
+// Where a thread runs and what memory it uses.
+struct thr {
+    const struct slab *slab;
+    struct he *hv;
+    uint64_t *filt; // NULL without the filter
+    int cpu; // -1 if not pinned
+    pthread_t tid;
+};
 
 void *worker(void *arg)
 {
-    struct he *hv = arg;
-    while (1) {
-	// lock
-	int rc = pthread_mutex_lock(&G.mutex);
+    struct thr *t = arg;
+    if (t->cpu >= 0)
+	numa_pin(t->cpu);
+    struct trial tr;
+    while (next_trial(&tr))
+	trial_done(&tr, G.incdir ? try_inc(t->slab, &tr, t->hv)
+				 : try(t->slab, G.nstr, &tr, t->hv, t->filt));
+    return arg;
+}
+
+// In the pipelined mode, each worker is split into a pair of threads which
+// share two buffers: while the sorter checks one seed, the hasher is already
+// filling the other buffer with the next seed.  Hashing keeps the multipliers
+// busy, and sorting keeps the memory busy, so the two stages overlap well
+// (especially on SMT siblings).
+struct pipe {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    const struct slab *slab;
+    struct he *hv[2];
+    uint64_t *filt[2];
+    struct trial t[2];
+    bool full[2];
+    bool done;
+    int cpu[2];
+    pthread_t tid[2];
+};
+
+void *hasher(void *arg)
+{
+    struct pipe *pp = arg;
+    if (pp->cpu[0] >= 0)
+	numa_pin(pp->cpu[0]);
+    struct trial t;
+    for (int k = 0; ; k ^= 1) {
+	int rc = pthread_mutex_lock(&pp->mutex);
+	assert(rc == 0);
+	while (pp->full[k])
+	    pthread_cond_wait(&pp->cond, &pp->mutex);
+	rc = pthread_mutex_unlock(&pp->mutex);
+	assert(rc == 0);
+	bool more = next_trial(&t);
+	if (more) {
+	    hash_all(pp->slab, 3, G.nstr, t.seed, pp->hv[k], pp->filt[k]);
+	    FALTER_SAVE(t.falter);
+	}
+	rc = pthread_mutex_lock(&pp->mutex);
 	assert(rc == 0);
-	// critical
-	int ntry = G.ntry--;
-	uint64_t seed = rand64();
-	// unlock
-	rc = pthread_mutex_unlock(&G.mutex);
+	if (more)
+	    pp->t[k] = t, pp->full[k] = true;
+	else
+	    pp->done = true;
+	pthread_cond_signal(&pp->cond);
+	rc = pthread_mutex_unlock(&pp->mutex);
 	assert(rc == 0);
-	// loop control
-	if (ntry <= 0)
+	if (!more)
 	    break;
-	try(&G.slab, G.nstr, seed, hv);
     }
     return arg;
 }
 
+void *sorter(void *arg)
+{
+    struct pipe *pp = arg;
+    if (pp->cpu[1] >= 0)
+	numa_pin(pp->cpu[1]);
+    for (int k = 0; ; k ^= 1) {
+	int rc = pthread_mutex_lock(&pp->mutex);
+	assert(rc == 0);
+	while (!pp->full[k] && !pp->done)
+	    pthread_cond_wait(&pp->cond, &pp->mutex);
+	bool full = pp->full[k];
+	rc = pthread_mutex_unlock(&pp->mutex);
+	assert(rc == 0);
+	if (!full)
+	    break;
+	trial_done(&pp->t[k], check(pp->slab, G.nstr, &pp->t[k], pp->hv[k], pp->filt[k]));
+	rc = pthread_mutex_lock(&pp->mutex);
+	assert(rc == 0);
+	pp->full[k] = false;
+	pthread_cond_signal(&pp->cond);
+	rc = pthread_mutex_unlock(&pp->mutex);
+	assert(rc == 0);
+    }
+    return arg;
+}
+
+// Orders the CPUs round-robin over the nodes, so that a few threads use
+// all the nodes.  The threads take the physical cores first, then the SMT
+// siblings.  The pipes take two CPUs at a time from a node, the siblings
+// of a core, or two cores without SMT (or one CPU twice, if it is the last).
+static void place_init(void)
+{
+    int n = G.topo.ncpu;
+    G.order = malloc(2 * n * sizeof(int));
+    int *rank = malloc(n * sizeof(int));
+    bool *taken = calloc(n, sizeof(bool));
+    assert(G.order && rank && taken);
+    // The rank of a CPU among its siblings, which are next to each other.
+    for (int k = 0; k < n; k++)
+	rank[k] = k > 0 && G.topo.core[k] == G.topo.core[k-1] ? rank[k-1] + 1 : 0;
+    int m = 0, left = n;
+    for (int r = 0; left > 0; r++) {
+	bool more = true;
+	while (more) {
+	    more = false;
+	    for (int node = 0; node < G.topo.nnode; node++) {
+		int k = 0;
+		while (k < n && (taken[k] || G.topo.node[k] != node || (!G.pipe && rank[k] != r)))
+		    k++;
+		if (k == n)
+		    continue;
+		more = true;
+		taken[k] = true, left--;
+		G.order[m++] = k;
+		if (!G.pipe)
+		    continue;
+		if (k + 1 < n && !taken[k+1] && G.topo.node[k+1] == node)
+		    taken[k+1] = true, left--, k++;
+		G.order[m++] = k;
+	    }
+	}
+    }
+    G.norder = m;
+    free(rank);
+    free(taken);
+}
+
+// Assigns the i-th thread to a CPU; returns its node.
+static int place(int i, int *cpu)
+{
+    if (!G.numa) {
+	*cpu = -1;
+	return -1;
+    }
+    int k = G.order[i % G.norder];
+    *cpu = G.topo.cpu[k];
+    return G.topo.node[k];
+}
+
+static void run_pipes(size_t hvsize)
+{
+    struct pipe *pipes = malloc(G.nthr * sizeof(struct pipe));
+    assert(pipes);
+    for (int i = 0; i < G.nthr; i++) {
+	struct pipe *pp = &pipes[i];
+	*pp = (struct pipe) { .done = false };
+	pthread_mutex_init(&pp->mutex, NULL);
+	pthread_cond_init(&pp->cond, NULL);
+	// The hasher and the sorter go to SMT siblings.
+	int node = place(2 * i + 0, &pp->cpu[0]);
+	place(2 * i + 1, &pp->cpu[1]);
+	pp->slab = &G.replica[node < 0 ? 0 : node];
+	for (int k = 0; k < 2; k++) {
+	    pp->hv[k] = numa_alloc(hvsize, node, G.huge);
+	    pp->filt[k] = G.fbits ? numa_alloc(G.fsize, node, G.huge) : NULL;
+	}
+	int rc = pthread_create(&pp->tid[0], NULL, hasher, pp);
+	assert(rc == 0);
+	rc = pthread_create(&pp->tid[1], NULL, sorter, pp);
+	assert(rc == 0);
+    }
+    for (int i = 0; i < G.nthr; i++) {
+	struct pipe *pp = &pipes[i];
+	for (int k = 0; k < 2; k++) {
+	    int rc = pthread_join(pp->tid[k], NULL);
+	    assert(rc == 0);
+	}
+	for (int k = 0; k < 2; k++) {
+	    numa_free(pp->hv[k], hvsize, G.huge);
+	    if (pp->filt[k])
+		numa_free(pp->filt[k], G.fsize, G.huge);
+	}
+    }
+    free(pipes);
+}
+
+static void run_workers(size_t hvsize)
+{
+    struct thr *thr = malloc(G.nthr * sizeof(struct thr));
+    assert(thr);
+    for (int i = 0; i < G.nthr; i++) {
+	struct thr *t = &thr[i];
+	int node = place(i, &t->cpu);
+	t->slab = &G.replica[node < 0 ? 0 : node];
+	t->hv = numa_alloc(hvsize, node, G.huge);
+	t->filt = G.fbits ? numa_alloc(G.fsize, node, G.huge) : NULL;
+	int rc = pthread_create(&t->tid, NULL, worker, t);
+	assert(rc == 0);
+    }
+    for (int i = 0; i < G.nthr; i++) {
+	struct thr *t = &thr[i];
+	int rc = pthread_join(t->tid, NULL);
+	assert(rc == 0);
+	numa_free(t->hv, hvsize, G.huge);
+	if (t->filt)
+	    numa_free(t->filt, G.fsize, G.huge);
+    }
+    free(thr);
+}
+
+// Prints the pairs which have collided under at least rmin seeds.
+static void recurring(void)
+{
+    struct pairent *v;
+    size_t n = pairmap_top(&G.pairs, G.rmin, &v);
+    FILE *fp = stdout;
+    for (size_t i = 0; i < n; i++) {
+	const char *s1 = slab_get(&G.slab, v[i].so1);
+	const char *s2 = slab_get(&G.slab, v[i].so2);
+	uint16_t len1, len2;
+	memcpy(&len1, s1 - 2, 2);
+	memcpy(&len2, s2 - 2, 2);
+	fprintf(fp, "# recurring %u ", v[i].cnt);
+	fwrite(s1, 1, len1, fp);
+	putc(' ', fp);
+	fwrite(s2, 1, len2, fp);
+	putc('\n', fp);
+    }
+    if (G.pairs.evicted)
+	fprintf(fp, "# recurring: %zu pairs evicted, the counts may be short by up to %u\n",
+		G.pairs.evicted, G.pairs.floor - 1);
+    free(v);
+}
+
+// In the worker mode, sends the pair counts to the coordinator, along with
+// the checksum of the strings: the pairs are identified by slab offsets.
+static void send_pairs(void)
+{
+    fprintf(G.out, "S %016" PRIx64 "\n", slab_sum(&G.slab, G.fill));
+    struct pairent *v;
+    size_t n = pairmap_top(&G.pairs, 1, &v);
+    for (size_t i = 0; i < n; i++)
+	fprintf(G.out, "P %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", v[i].so1, v[i].so2, v[i].cnt);
+    fprintf(G.out, "V %zu %" PRIu32 "\n", G.pairs.evicted, G.pairs.floor);
+    free(v);
+}
+
+// Merges the lines which the workers send before they exit.
+static bool merge(const char *line, size_t len)
+{
+    uint32_t so1, so2, cnt;
+    uint64_t sum;
+    size_t evicted;
+    int k;
+    (void) len;
+    switch (*line) {
+    case 'S':
+	if (!G.rmin || sscanf(line + 2, "%" SCNx64, &sum) != 1)
+	    return false;
+	// The workers must have the same strings as the coordinator.
+	assert(sum == G.sum);
+	return true;
+    case 'P':
+	if (!G.rmin || sscanf(line + 2, "%" SCNu32 " %" SCNu32 " %" SCNu32,
+		    &so1, &so2, &cnt) != 3)
+	    return false;
+	assert(so1 < so2 && so2 < G.fill);
+	pairmap_addn(&G.pairs, so1, so2, cnt);
+	return true;
+    case 'V':
+	if (!G.rmin || sscanf(line + 2, "%zu %" SCNu32, &evicted, &cnt) != 2)
+	    return false;
+	// The counts merged from this worker may be short, too.
+	G.pairs.evicted += evicted;
+	if (G.pairs.floor < cnt)
+	    G.pairs.floor = cnt;
+	return true;
+    case 'W':
+	if (sscanf(line + 2, "%" SCNu32 " %" SCNu64, &cnt, &sum) != 2)
+	    return false;
+	// The coordinator must have the same sweep sizes.
+	for (k = 0; k < G.nsweep; k++)
+	    if (G.sweep[k] == cnt)
+		break;
+	if (k == G.nsweep)
+	    return false;
+	G.swpairs[k] += sum;
+	return true;
+    }
+    return false;
+}
+
+// Indexes the strings for the sweep.
+static void sweep_init(void)
+{
+    assert(G.sweep[G.nsweep-1] <= G.nstr);
+    G.offs = malloc(G.nstr * sizeof *G.offs);
+    assert(G.offs);
+    uint32_t so = 3;
+    for (uint32_t i = 0; i < G.nstr; i++) {
+	uint16_t len;
+	memcpy(&len, slab_get(&G.slab, so - 2), 2);
+	G.offs[i] = so;
+	so += len + 2;
+    }
+}
+
+// Ranks the strings for the random subsets.
+static void sweep_rank(uint64_t seed)
+{
+    G.rank = malloc(G.nstr * sizeof *G.rank);
+    assert(G.rank);
+    for (uint32_t i = 0; i < G.nstr; i++)
+	G.rank[i] = i;
+    for (uint32_t i = G.nstr - 1; i > 0; i--) {
+	uint32_t j = (uint32_t) rrmxmx(seed + i) * (uint64_t)(i + 1) >> 32;
+	uint32_t r = G.rank[i]; G.rank[i] = G.rank[j]; G.rank[j] = r;
+    }
+}
+
+// With random collisions, the number of pairs grows as C(n,2), so the
+// ratio to the expected number should not depend on the size.
+// In the worker mode, the counts are sent to the coordinator instead.
+static void sweep_report(void)
+{
+    FILE *fp = stdout;
+    if (G.in) {
+	for (int k = 0; k < G.nsweep; k++)
+	    fprintf(G.out, "W %" PRIu32 " %" PRIu64 "\n", G.sweep[k], G.swpairs[k]);
+	return;
+    }
+    for (int k = 0; k < G.nsweep; k++) {
+	double n = G.sweep[k];
+	double e = ldexp(n * (n - 1) / 2 * G.ntrial, -64);
+	fprintf(fp, "# sweep %" PRIu32 " pairs %" PRIu64 " trials %" PRIu64 " exp %.3g ratio %.3g\n",
+		G.sweep[k], G.swpairs[k], G.ntrial, e, G.swpairs[k] / e);
+    }
+}
+
+// Sizes the filter.  With about log2(nstr)+2 bits, a quarter of the buckets
+// are taken.  More bits make fewer candidates, but the filters, one per
+// thread (two with -p), should stay in the last-level cache.  The explicit
+// number of bits must be within a few bits of log2(nstr).
+static void filter_init(void)
+{
+    int lg = 31 - __builtin_clz(G.nstr);
+    int lo = lg > 8 ? lg : 8;
+    if (G.fbits < 0) {
+	long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (llc <= 0)
+	    llc = 8 << 20;
+	size_t nfilt = G.nthr * (G.pipe ? 2 : 1);
+	G.fbits = lg + 2 > lo ? lg + 2 : lo;
+	while (G.fbits > lo && nfilt << (G.fbits - 2) > (size_t) llc)
+	    G.fbits--;
+    }
+    assert(G.fbits >= lo && G.fbits <= lo + 4 && G.fbits <= 32);
+    G.fsize = (size_t) 1 << (G.fbits - 2);
+}
+
+// Generates the strings, e.g. "mangled:10000000" or "zeroes:1000000:2a".
+static void generate(const char *spec)
+{
+    char name[32];
+    uint32_t n;
+    uint64_t seed = 0;
+    int rc = sscanf(spec, "%31[^:]:%" SCNu32 ":%" SCNx64, name, &n, &seed);
+    assert(rc >= 2 && n > 0);
+    gen_fill(&G.slab, name, n, seed, MINLEN, G.nthr);
+    G.nstr = n;
+}
+
+// Loads or generates the strings, and pads the slab.
+static void load(const char *gspec)
+{
+    slab_init(&G.slab);
+    if (gspec)
+	generate(gspec);
+    else
+	G.nstr = zload(&G.slab, 0, MINLEN, G.nthr);
+    G.fill = G.slab.fill;
+    static const char pad[64];
+    slab_put(&G.slab, pad, sizeof pad);
+}
+
 int main(int argc, char **argv)
 {
-#define MAXTHR 32
     G.ntry = 16;
     G.nthr = 2;
+    G.huge = NUMA_THP;
+    G.logpairs = 24;
+    const char *laddr = NULL, *caddr = NULL, *gspec = NULL;
+    int batch = 16;
 
     int opt;
-    while ((opt = getopt(argc, argv, "j:")) != -1)
+    while ((opt = getopt(argc, argv, "j:pNH:l:c:b:s:k:r:m:g:i:w:Rf:v")) != -1)
     switch (opt) {
     case 'j':
 	G.nthr = atoi(optarg);
-	assert(G.nthr > 0 && G.nthr <= MAXTHR);
+	assert(G.nthr > 0);
+	break;
+    case 'p':
+	G.pipe = true;
+	break;
+    case 'N':
+	G.numa = true;
+	break;
+    case 'H':
+	if (strcmp(optarg, "2m") == 0)
+	    G.huge = NUMA_2M;
+	else {
+	    assert(strcmp(optarg, "1g") == 0);
+	    G.huge = NUMA_1G;
+	}
+	break;
+    case 'l':
+	laddr = optarg;
+	break;
+    case 'c':
+	caddr = optarg;
+	break;
+    case 'b':
+	batch = atoi(optarg);
+	assert(batch > 0);
+	break;
+    case 's':
+	G.seed0 = strtoull(optarg, NULL, 16);
+	G.seeded = true;
+	break;
+    case 'k':
+	// e.g. -k 24,32,40,48
+	for (char *p = optarg; *p; p += *p == ',') {
+	    assert(G.nk < 8);
+	    G.k[G.nk] = strtol(p, &p, 10);
+	    assert(G.k[G.nk] > 0 && G.k[G.nk] <= 64);
+	    G.nk++;
+	}
+	break;
+    case 'r':
+	G.rmin = atoi(optarg);
+	assert(G.rmin > 0);
+	break;
+    case 'm':
+	// the pair map has 2^m slots, 12 bytes each
+	G.logpairs = atoi(optarg);
+	assert(G.logpairs >= 10 && G.logpairs <= 30);
+	break;
+    case 'g':
+	gspec = optarg;
+	break;
+    case 'i':
+	G.incdir = optarg;
+	break;
+    case 'w':
+	// e.g. -w 1000000,2000000,4000000
+	for (char *p = optarg; *p; p += *p == ',') {
+	    assert(G.nsweep < 16);
+	    G.sweep[G.nsweep] = strtoul(p, &p, 10);
+	    assert(G.sweep[G.nsweep] > 1);
+	    assert(G.nsweep == 0 || G.sweep[G.nsweep] > G.sweep[G.nsweep-1]);
+	    G.nsweep++;
+	}
+	break;
+    case 'R':
+	G.swrandom = true;
+	break;
+    case 'f':
+	// -f auto, or the number of bits, see filter_init()
+	G.fbits = strcmp(optarg, "auto") ? atoi(optarg) : -1;
+	assert(G.fbits != 0);
+	break;
+    case 'v':
+	G.verbose = true;
 	break;
     default:
 	assert(!!!"getopt");
@@ -220,46 +1185,106 @@ int main(int argc, char **argv)
 	G.ntry = atoi(argv[optind]);
 	assert(G.ntry > 0);
     }
-    assert(G.ntry >= G.nthr);
+    assert(!(laddr && caddr));
+    // Runs are only reusable with the same seeds; the stats need all pairs.
+    assert(!G.incdir || (G.seeded && !caddr && !G.pipe && !G.nk));
+    assert(!(G.incdir && G.nsweep));
+    // The stats need the full sort; the runs are merged in full.
+    assert(!G.fbits || (!G.nk && !G.incdir));
 
-    slab_init(&G.slab);
+    uint64_t t0 = now();
+    // The coordinator needs the strings only to print the recurring pairs.
+    if (!laddr || G.rmin)
+	load(gspec);
+    if (laddr) {
+	if (G.rmin) {
+	    G.sum = slab_sum(&G.slab, G.fill);
+	    pairmap_init(&G.pairs, G.logpairs);
+	}
+	int lfd = shard_listen(laddr);
+	G.ntrial = shard_coordinate(lfd, G.ntry, batch, G.seeded ? G.seed0 : rand64(), merge);
+	if (G.rmin) {
+	    recurring();
+	    pairmap_fini(&G.pairs);
+	}
+	if (G.nsweep)
+	    sweep_report();
+	return 0;
+    }
+    G.out = stdout;
+    if (!caddr) {
+	assert(G.ntry >= G.nthr);
+	G.end = G.ntry;
+    }
+    if (G.fbits)
+	filter_init();
 
-    char *line = NULL;
-    size_t alloc = 0;
-    while (1) {
-	ssize_t len = getline(&line, &alloc, stdin);
-	if (len < 0)
-	    break;
-	assert(len > 1);
-	len--;
-	assert(line[len] == '\n');
-	if (len < MINLEN)
-	    continue;
-	if (len > UINT16_MAX)
-	    continue;
-	slab_reserve(&G.slab, 2 + len);
-	uint16_t len16 = len;
-	slab_copy(&G.slab, &len16, 2);
-	slab_copy(&G.slab, line, len);
-	G.nstr++;
-    }
-    free(line);
-    const char pad[64] = "";
-    slab_put(&G.slab, pad, sizeof pad);
+    if (G.incdir) {
+	int rc = mkdir(G.incdir, 0777);
+	assert(rc == 0 || errno == EEXIST);
+	G.sum = slab_sum(&G.slab, G.fill);
+    }
+    if (G.nsweep) {
+	sweep_init();
+	// In the worker mode, the seed comes with the first range.
+	if (G.swrandom && !caddr)
+	    sweep_rank(G.seeded ? G.seed0 : rand64());
+    }
+
+    if (caddr) {
+	int fd = shard_connect(caddr);
+	G.in = fdopen(fd, "r");
+	G.out = fdopen(dup(fd), "w");
+	assert(G.in && G.out);
+	// Writes to a closed connection fail with EPIPE instead.
+	signal(SIGPIPE, SIG_IGN);
+    }
+
+    // Replicate the slab on each node.
+    numa_init(&G.topo);
+    if (!G.numa)
+	G.topo.nnode = 1;
+    else
+	place_init();
+    G.replica = malloc(G.topo.nnode * sizeof(struct slab));
+    assert(G.replica);
+    for (int node = 0; node < G.topo.nnode; node++) {
+	struct slab *r = &G.replica[node];
+	*r = G.slab;
+	if (G.numa) {
+	    r->base = numa_alloc(G.slab.fill, node, G.huge);
+	    memcpy(r->base, G.slab.base, G.slab.fill);
+	}
+    }
 
-    pthread_t tid[MAXTHR];
+    uint64_t t1 = now();
     pthread_mutex_init(&G.mutex, NULL);
-    for (int i = 0; i < G.nthr; i++) {
-	void *mem = malloc(2 * (G.nstr + 1) * sizeof(struct he));
-	assert(mem);
-	int rc = pthread_create(&tid[i], NULL, worker, mem);
-	assert(rc == 0);
+    size_t hvsize = 2 * (G.nstr + 1) * sizeof(struct he);
+    if (G.rmin)
+	pairmap_init(&G.pairs, G.logpairs);
+    if (G.pipe)
+	run_pipes(hvsize);
+    else
+	run_workers(hvsize);
+    uint64_t t2 = now();
+    if (G.rmin) {
+	if (G.in)
+	    send_pairs();
+	else
+	    recurring();
+	pairmap_fini(&G.pairs);
     }
-    for (int i = 0; i < G.nthr; i++) {
-	void *mem;
-	int rc = pthread_join(tid[i], &mem);
-	assert(rc == 0);
-	free(mem);
+    if (G.nsweep)
+	sweep_report();
+    // Machine-readable, for bench.sh.  The phases are in thread-seconds.
+    if (G.verbose) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	fprintf(stderr, "# time load=%.3f run=%.3f hash=%.3f sort=%.3f scan=%.3f "
+		"trials=%" PRIu64 " strings=%" PRIu32 " threads=%d rss=%ld skipped=%" PRIu64 "\n",
+		(t1 - t0) / 1e9, (t2 - t1) / 1e9,
+		G.ns[T_HASH] / 1e9, G.ns[T_SORT] / 1e9, G.ns[T_SCAN] / 1e9,
+		G.ntrial, G.nstr, G.nthr, ru.ru_maxrss, G.nskip);
     }
     return 0;
 }
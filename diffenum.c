@@ -0,0 +1,452 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Exhaustive differential enumeration for the update() of hash1.h.
+// A low-weight XOR difference delta is put into one lane of a data block;
+// the lane's state word s is half of the seed.  For every one of the 2^32
+// data words d, we compare x = s + d with x' = s + (d ^ delta).  The lane's
+// product m = lo16(x) * hi16(x) goes into its own state word, so if m == m'
+// (the multiplication "cancels" the difference), the only difference left
+// is rotl32(x, 16) vs rotl32(x', 16) in the other state word.  A second
+// block with a difference delta2 in the other lane can then cancel that
+// too, and this is how the collisions in trace1-xor.c and trace2-add.c
+// come about (the same byte is read twice, due to the overlapping last8).
+//
+// For each delta, we count the cancellations and the near-cancellations
+// (m ^ m' of weight at most -l), and keep the histogram of the remaining
+// differences.  The two-block probability is then computed exactly for
+// each delta2 of weight at most -w: whether (u ^ v) + (d ^ delta2) equals
+// u + d (XOR combining, u being the state word, v the difference), or
+// v + (d ^ delta2) equals d (ADD combining), is counted bit by bit with
+// the carries.
+//
+// A unit of work is a (delta, lane, seed) triple.  Completed units are
+// appended to the checkpoint file (-c), which is read back on restart.
+// The inner loop is meant to be auto-vectorized:
+//
+//	gcc -O3 -march=native -Wall -o diffenum diffenum.c -lpthread -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/auxv.h>
+
+static inline uint32_t rotl32(uint32_t x, int k) { return x << k | x >> (32 - k); }
+static inline uint64_t rotr64(uint64_t x, int k) { return x >> k | x << (64 - k); }
+
+// A known-good mixing step, by Pelle Evensen.
+static inline uint64_t rrmxmx(uint64_t x)
+{
+    x ^= rotr64(x, 49) ^ rotr64(x, 24);
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    return x;
+}
+
+static __uint128_t rand64state;
+
+static __attribute__((constructor)) void rand64init(void)
+{
+    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
+    rand64state |= 1;
+}
+
+static inline uint64_t rand64(void)
+{
+    uint64_t ret = rand64state >> 64;
+    rand64state *= 0xda942042e4dd58b5;
+    return ret;
+}
+
+// The distinct differences left in the other state word.
+#define NV 64
+
+struct unit {
+    uint32_t delta;
+    int lane;
+    uint64_t seed;
+    bool done;
+    uint64_t cancel, low;
+    int nv;
+    uint32_t v[NV];
+    uint64_t c[NV];
+    uint64_t vdrop;
+};
+
+static struct {
+    int nthr;
+    int maxw;  // the weight of delta and delta2
+    int lowl;  // near-cancellation: m ^ m' of weight up to lowl
+    bool xor;  // the combining step, ADD or XOR
+    struct unit *u;
+    size_t nu, next;
+    FILE *ckpt;
+    pthread_mutex_t mutex;
+} G;
+
+static inline uint32_t mul16(uint32_t x)
+{
+    return (uint16_t) x * (x >> 16);
+}
+
+static void addv(struct unit *u, uint32_t v, uint64_t c)
+{
+    for (int i = 0; i < u->nv; i++)
+	if (u->v[i] == v) {
+	    u->c[i] += c;
+	    return;
+	}
+    if (u->nv < NV)
+	u->v[u->nv] = v, u->c[u->nv++] = c;
+    else
+	u->vdrop += c;
+}
+
+#define BLOCK 4096
+#define NTOP 8
+#define MAXL 8
+
+static void enumerate(struct unit *u)
+{
+    uint32_t s = u->lane ? u->seed >> 32 : u->seed;
+    uint32_t delta = u->delta;
+    int lowl = G.lowl;
+    for (uint64_t base = 0; base < (UINT64_C(1) << 32); base += BLOCK) {
+	uint32_t cancel = 0, low = 0;
+	for (uint32_t i = 0; i < BLOCK; i++) {
+	    uint32_t d = base + i;
+	    uint32_t x = s + d, y = s + (d ^ delta);
+	    uint32_t c = mul16(x) ^ mul16(y);
+	    cancel += c == 0;
+	    // Clear the lowest lowl bits, with a fixed trip count.
+	    for (int k = 0; k < MAXL; k++)
+		c &= c - (k < lowl);
+	    low += c == 0;
+	}
+	u->low += low;
+	if (!cancel)
+	    continue;
+	u->cancel += cancel;
+	for (uint32_t i = 0; i < BLOCK; i++) {
+	    uint32_t d = base + i;
+	    uint32_t x = s + d, y = s + (d ^ delta);
+	    if (mul16(x) != mul16(y))
+		continue;
+	    uint32_t v = G.xor ? rotl32(x ^ y, 16) : rotl32(y, 16) - rotl32(x, 16);
+	    addv(u, v, 1);
+	}
+    }
+}
+
+// The probability that the second block cancels the difference v.
+static double cancel2(uint32_t v, uint32_t delta2)
+{
+    if (!G.xor) {
+	// v + (d ^ delta2) == d, over d.
+	double n[2] = { 1, 0 };
+	for (int i = 0; i < 32; i++) {
+	    double m[2] = { 0, 0 };
+	    int a = v >> i & 1, b = delta2 >> i & 1;
+	    for (int c = 0; c < 2; c++)
+		for (int d = 0; d < 2; d++) {
+		    int s = a + (d ^ b) + c;
+		    if ((s & 1) == d)
+			m[s >> 1] += n[c];
+		}
+	    n[0] = m[0], n[1] = m[1];
+	}
+	return ldexp(n[0] + n[1], -32);
+    }
+    // (u ^ v) + (d ^ delta2) == u + d, over u and d.
+    double n[4] = { 1, 0, 0, 0 };
+    for (int i = 0; i < 32; i++) {
+	double m[4] = { 0, 0, 0, 0 };
+	int a = v >> i & 1, b = delta2 >> i & 1;
+	for (int c = 0; c < 4; c++)
+	    for (int u = 0; u < 2; u++)
+		for (int d = 0; d < 2; d++) {
+		    int s1 = (u ^ a) + (d ^ b) + (c & 1);
+		    int s2 = u + d + (c >> 1);
+		    if ((s1 & 1) == (s2 & 1))
+			m[(s1 >> 1) | (s2 >> 1) << 1] += n[c];
+		}
+	memcpy(n, m, sizeof n);
+    }
+    return ldexp(n[0] + n[1] + n[2] + n[3], -64);
+}
+
+static void save(const struct unit *u)
+{
+    if (!G.ckpt)
+	return;
+    fprintf(G.ckpt, "U %08" PRIx32 " %d %016" PRIx64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
+	    u->delta, u->lane, u->seed, u->cancel, u->low, u->vdrop);
+    for (int i = 0; i < u->nv; i++)
+	fprintf(G.ckpt, " %08" PRIx32 ":%" PRIu64, u->v[i], u->c[i]);
+    fputc('\n', G.ckpt);
+    fflush(G.ckpt);
+}
+
+static void restore(const char *fname)
+{
+    FILE *fp = fopen(fname, "r");
+    if (!fp)
+	return;
+    char *line = NULL;
+    size_t alloc = 0;
+    size_t n = 0;
+    while (getline(&line, &alloc, fp) > 0) {
+	int xor, lowl, pos;
+	if (sscanf(line, "# diffenum xor=%d l=%d", &xor, &lowl) == 2) {
+	    assert(xor == G.xor && lowl == G.lowl);
+	    continue;
+	}
+	struct unit r = { 0, };
+	int rc = sscanf(line, "U %" SCNx32 " %d %" SCNx64 " %" SCNu64 " %" SCNu64 " %" SCNu64 "%n",
+		&r.delta, &r.lane, &r.seed, &r.cancel, &r.low, &r.vdrop, &pos);
+	assert(rc == 6);
+	for (char *p = line + pos; *p && *p != '\n'; p += pos) {
+	    uint32_t v;
+	    uint64_t c;
+	    rc = sscanf(p, " %" SCNx32 ":%" SCNu64 "%n", &v, &c, &pos);
+	    assert(rc == 2);
+	    addv(&r, v, c);
+	}
+	for (size_t i = 0; i < G.nu; i++) {
+	    struct unit *u = &G.u[i];
+	    if (!u->done && u->delta == r.delta && u->lane == r.lane && u->seed == r.seed) {
+		*u = r, u->done = true, n++;
+		break;
+	    }
+	}
+    }
+    free(line);
+    fclose(fp);
+    fprintf(stderr, "%s: %zu units restored\n", fname, n);
+}
+
+static void *worker(void *arg)
+{
+    while (1) {
+	int rc = pthread_mutex_lock(&G.mutex);
+	assert(rc == 0);
+	while (G.next < G.nu && G.u[G.next].done)
+	    G.next++;
+	struct unit *u = G.next < G.nu ? &G.u[G.next++] : NULL;
+	rc = pthread_mutex_unlock(&G.mutex);
+	assert(rc == 0);
+	if (!u)
+	    break;
+	enumerate(u);
+	rc = pthread_mutex_lock(&G.mutex);
+	assert(rc == 0);
+	u->done = true;
+	save(u);
+	rc = pthread_mutex_unlock(&G.mutex);
+	assert(rc == 0);
+    }
+    return arg;
+}
+
+// A row of the table: a delta in a lane, over all seeds.
+struct row {
+    uint32_t delta;
+    int lane;
+    double cancel, low;
+    uint32_t delta2;
+    double p2;
+};
+
+static int cmprow(const void *a, const void *b)
+{
+    const struct row *r1 = a, *r2 = b;
+    if (r1->p2 != r2->p2)
+	return r1->p2 < r2->p2 ? 1 : -1;
+    if (r1->cancel != r2->cancel)
+	return r1->cancel < r2->cancel ? 1 : -1;
+    return 0;
+}
+
+// The weight-w words, one at a time: returns false after the last one.
+static bool nextw(uint32_t *x)
+{
+    // Gosper's hack, in 64 bits to detect the end.
+    uint64_t w = *x;
+    uint64_t c = w & -w, r = w + c;
+    w = (((r ^ w) >> 2) / c) | r;
+    if (w >> 32)
+	return false;
+    *x = w;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    G.nthr = 2;
+    G.maxw = 2;
+    G.lowl = 4;
+    uint64_t seed0 = rand64();
+    int nseed = 1, top = 40;
+    const char *ckpt = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:n:w:l:xc:t:")) != -1)
+    switch (opt) {
+    case 'j':
+	G.nthr = atoi(optarg);
+	assert(G.nthr > 0);
+	break;
+    case 's':
+	seed0 = strtoull(optarg, NULL, 16);
+	break;
+    case 'n':
+	nseed = atoi(optarg);
+	assert(nseed > 0);
+	break;
+    case 'w':
+	G.maxw = atoi(optarg);
+	assert(G.maxw > 0 && G.maxw <= 4);
+	break;
+    case 'l':
+	G.lowl = atoi(optarg);
+	assert(G.lowl >= 0 && G.lowl <= MAXL);
+	break;
+    case 'x':
+	G.xor = true;
+	break;
+    case 'c':
+	ckpt = optarg;
+	break;
+    case 't':
+	top = atoi(optarg);
+	break;
+    default:
+	assert(!!!"getopt");
+    }
+
+    // The seeds are given on the command line, or else derived from -s
+    // the same way as the campaign seeds in collisions.c.
+    uint64_t *seeds;
+    if (optind < argc) {
+	nseed = argc - optind;
+	seeds = malloc(nseed * sizeof *seeds);
+	assert(seeds);
+	for (int i = 0; i < nseed; i++)
+	    seeds[i] = strtoull(argv[optind + i], NULL, 16);
+    }
+    else {
+	seeds = malloc(nseed * sizeof *seeds);
+	assert(seeds);
+	for (int i = 0; i < nseed; i++)
+	    seeds[i] = rrmxmx(seed0 + i);
+    }
+
+    // All deltas of weight 1..maxw, for both lanes and all seeds.
+    size_t ndelta = 0;
+    uint32_t *deltas = NULL;
+    for (int w = 1; w <= G.maxw; w++) {
+	uint32_t x = UINT32_MAX >> (32 - w);
+	do {
+	    if (ndelta % 1024 == 0)
+		deltas = realloc(deltas, (ndelta + 1024) * sizeof *deltas);
+	    assert(deltas);
+	    deltas[ndelta++] = x;
+	} while (nextw(&x));
+    }
+    G.nu = ndelta * 2 * nseed;
+    G.u = calloc(G.nu, sizeof *G.u);
+    assert(G.u);
+    for (size_t i = 0, k = 0; i < ndelta; i++)
+	for (int lane = 0; lane < 2; lane++)
+	    for (int j = 0; j < nseed; j++, k++)
+		G.u[k].delta = deltas[i], G.u[k].lane = lane, G.u[k].seed = seeds[j];
+
+    if (ckpt) {
+	restore(ckpt);
+	G.ckpt = fopen(ckpt, "a");
+	assert(G.ckpt);
+	fprintf(G.ckpt, "# diffenum xor=%d l=%d\n", G.xor, G.lowl);
+	fflush(G.ckpt);
+    }
+    pthread_mutex_init(&G.mutex, NULL);
+    pthread_t tid[G.nthr];
+    for (int i = 0; i < G.nthr; i++) {
+	int rc = pthread_create(&tid[i], NULL, worker, NULL);
+	assert(rc == 0);
+    }
+    for (int i = 0; i < G.nthr; i++) {
+	int rc = pthread_join(tid[i], NULL);
+	assert(rc == 0);
+    }
+
+    // Merge the seeds, and find the best delta2 for each row.  Only the
+    // most frequent differences are tried against each delta2.
+    size_t nrow = ndelta * 2;
+    struct row *rows = calloc(nrow, sizeof *rows);
+    assert(rows);
+    for (size_t r = 0; r < nrow; r++) {
+	struct row *row = &rows[r];
+	struct unit *u = &G.u[r * nseed];
+	struct unit m = { 0, };
+	row->delta = u->delta, row->lane = u->lane;
+	for (int j = 0; j < nseed; j++) {
+	    row->cancel += u[j].cancel, row->low += u[j].low;
+	    for (int k = 0; k < u[j].nv; k++)
+		addv(&m, u[j].v[k], u[j].c[k]);
+	}
+	double N = ldexp(nseed, 32);
+	row->cancel /= N, row->low /= N;
+	int ntop = m.nv < NTOP ? m.nv : NTOP;
+	for (int k = 0; k < ntop; k++)
+	    for (int l = k + 1; l < m.nv; l++)
+		if (m.c[l] > m.c[k]) {
+		    uint32_t v = m.v[k]; m.v[k] = m.v[l]; m.v[l] = v;
+		    uint64_t c = m.c[k]; m.c[k] = m.c[l]; m.c[l] = c;
+		}
+	for (size_t i = 0; i < ndelta; i++) {
+	    double p2 = 0;
+	    for (int k = 0; k < ntop; k++)
+		p2 += m.c[k] / N * cancel2(m.v[k], deltas[i]);
+	    if (p2 > row->p2)
+		row->p2 = p2, row->delta2 = deltas[i];
+	}
+    }
+    qsort(rows, nrow, sizeof *rows, cmprow);
+    printf("# %s, %d seed(s), log2 probabilities\n", G.xor ? "XOR" : "ADD", nseed);
+    printf("# delta\tlane\tcancel\tlow\tdelta2 (in the other lane)\ttwo-block\n");
+    for (size_t r = 0; r < nrow && r < (size_t) top; r++)
+	printf("%08" PRIx32 "\t%d\t%.2f\t%.2f\t%08" PRIx32 "\t%.2f\n",
+		rows[r].delta, rows[r].lane, log2(rows[r].cancel), log2(rows[r].low),
+		rows[r].delta2, log2(rows[r].p2));
+    uint64_t vdrop = 0;
+    for (size_t i = 0; i < G.nu; i++)
+	vdrop += G.u[i].vdrop;
+    if (vdrop)
+	printf("# %" PRIu64 " cancellations with too many distinct differences not counted\n", vdrop);
+    return 0;
+}
@@ -0,0 +1,311 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Parallel collision search with distinguished points, in the style of
+// van Oorschot and Wiener.  Instead of hashing a given corpus, we walk
+// pseudo-random chains x -> hash(msg(x)), where msg(x) is a fixed prefix
+// followed by x in hex.  Only the distinguished points (those with the low
+// -d bits zero) are stored, in a table shared by all threads.  When two
+// chains arrive at the same distinguished point, they are walked again
+// from their starts to find where they merge, which gives two different
+// messages with the same hash value.  With the messages of a fixed length,
+// the final mixing step in hash1.h is a bijection, and hash8.h has none,
+// so a 64-bit collision is a collision in the update state.  With -b,
+// the hash value is truncated, which finds collisions much faster but
+// only checks the search itself.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/auxv.h>
+
+static inline uint16_t rotl16(uint16_t x, int k) { return x << k | x >> (16 - k); }
+static inline uint16_t rotr16(uint16_t x, int k) { return x >> k | x << (16 - k); }
+static inline uint32_t rotl32(uint32_t x, int k) { return x << k | x >> (32 - k); }
+static inline uint32_t rotr32(uint32_t x, int k) { return x >> k | x << (32 - k); }
+static inline uint64_t rotl64(uint64_t x, int k) { return x << k | x >> (64 - k); }
+static inline uint64_t rotr64(uint64_t x, int k) { return x >> k | x << (64 - k); }
+
+// A known-good mixing step, by Pelle Evensen.
+static inline uint64_t rrmxmx(uint64_t x)
+{
+    x ^= rotr64(x, 49) ^ rotr64(x, 24);
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    return x;
+}
+
+#include INC // e.g. "hash1.h" the original construction
+
+#ifndef MINLEN
+#define MINLEN 1
+#endif
+
+static __uint128_t rand64state;
+
+static __attribute__((constructor)) void rand64init(void)
+{
+    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
+    rand64state |= 1;
+}
+
+static inline uint64_t rand64(void)
+{
+    uint64_t ret = rand64state >> 64;
+    rand64state *= 0xda942042e4dd58b5;
+    return ret;
+}
+
+static struct {
+    uint64_t seed;
+    uint64_t mask;  // hash bits in use
+    uint64_t dmask; // distinguished if (x & dmask) == 0
+    uint64_t maxlen;
+    char prefix[64];
+    size_t plen;
+    // the table of distinguished points
+    struct dp {
+	uint64_t key; // the point | 1, or 0 if the slot is free
+	uint64_t start;
+	uint64_t len;
+	int ready;
+    } *dp;
+    size_t dpmask;
+    size_t dpfill;
+    bool full; // the table is 3/4 full, the search stops
+    // the search stops when enough collisions are found; chains which
+    // merge into a known chain lead to the same pair again
+    int want;
+    int found;
+    uint64_t (*pairs)[2];
+    uint64_t dups;
+    pthread_mutex_t mutex;
+    int nthr;
+    // statistics
+    uint64_t steps, chains;
+} G;
+
+// The message for a point: the prefix followed by 16 hex digits.
+static inline size_t msg(uint64_t x, char buf[80])
+{
+    static const char hex[16] = "0123456789abcdef";
+    memcpy(buf, G.prefix, G.plen);
+    for (int i = 0; i < 16; i++)
+	buf[G.plen + i] = hex[x >> (60 - 4 * i) & 15];
+    return G.plen + 16;
+}
+
+static inline uint64_t f(uint64_t x)
+{
+    char buf[80];
+    size_t len = msg(x, buf);
+    return hash(buf, len, G.seed) & G.mask;
+}
+
+// Walks two chains which end at the same distinguished point, and reports
+// the collision where they merge.
+static void resolve(uint64_t a, uint64_t la, uint64_t b, uint64_t lb)
+{
+    for (; la > lb; la--)
+	a = f(a);
+    for (; lb > la; lb--)
+	b = f(b);
+    // One start lies on the other chain, no collision.
+    if (a == b)
+	return;
+    uint64_t fa, fb;
+    while ((fa = f(a)) != (fb = f(b)))
+	a = fa, b = fb;
+    // The same pair may be found from other chains.
+    if (a > b) {
+	uint64_t x = a;
+	a = b, b = x;
+    }
+    char buf1[80], buf2[80];
+    size_t len1 = msg(a, buf1);
+    size_t len2 = msg(b, buf2);
+    uint64_t h1 = hash(buf1, len1, G.seed);
+    uint64_t h2 = hash(buf2, len2, G.seed);
+    int rc = pthread_mutex_lock(&G.mutex);
+    assert(rc == 0);
+    bool dup = false;
+    for (int i = 0; i < G.found && !dup; i++)
+	dup = G.pairs[i][0] == a && G.pairs[i][1] == b;
+    G.dups += dup;
+    if (!dup && G.found < G.want) {
+	G.pairs[G.found][0] = a;
+	G.pairs[G.found][1] = b;
+	printf("%016" PRIx64 " %016" PRIx64 " %.*s\n", G.seed, h1, (int) len1, buf1);
+	printf("%016" PRIx64 " %016" PRIx64 " %.*s\n", G.seed, h2, (int) len2, buf2);
+	fflush(stdout);
+	G.found++;
+    }
+    rc = pthread_mutex_unlock(&G.mutex);
+    assert(rc == 0);
+}
+
+// Stores a distinguished point, lock-free.  If the point is already there,
+// returns the entry, otherwise returns NULL.  The low bits of the point are
+// zero, so the slot is picked with a proper mixer.
+static struct dp *insert(uint64_t x, uint64_t start, uint64_t len)
+{
+    uint64_t key = x | 1;
+    size_t i = rrmxmx(x);
+    while (1) {
+	i &= G.dpmask;
+	struct dp *e = &G.dp[i];
+	uint64_t k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+	if (k == 0) {
+	    size_t fill = __atomic_add_fetch(&G.dpfill, 1, __ATOMIC_RELAXED);
+	    if (fill > G.dpmask / 4 * 3) {
+		__atomic_sub_fetch(&G.dpfill, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&G.full, true, __ATOMIC_RELAXED);
+		return NULL;
+	    }
+	    if (__atomic_compare_exchange_n(&e->key, &k, key, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		e->start = start;
+		e->len = len;
+		__atomic_store_n(&e->ready, 1, __ATOMIC_RELEASE);
+		return NULL;
+	    }
+	    __atomic_sub_fetch(&G.dpfill, 1, __ATOMIC_RELAXED);
+	}
+	if (k == key) {
+	    // The other thread may still be filling in the entry.
+	    while (!__atomic_load_n(&e->ready, __ATOMIC_ACQUIRE))
+		;
+	    return e;
+	}
+	i++;
+    }
+}
+
+void *worker(void *arg)
+{
+    uint64_t steps = 0, chains = 0;
+    while (__atomic_load_n(&G.found, __ATOMIC_RELAXED) < G.want &&
+	    !__atomic_load_n(&G.full, __ATOMIC_RELAXED)) {
+	int rc = pthread_mutex_lock(&G.mutex);
+	assert(rc == 0);
+	uint64_t start = rand64() & G.mask;
+	rc = pthread_mutex_unlock(&G.mutex);
+	assert(rc == 0);
+	uint64_t x = start, len = 0;
+	do
+	    x = f(x), len++;
+	while ((x & G.dmask) && len < G.maxlen);
+	steps += len;
+	chains++;
+	// Chains which are too long have probably fallen into a cycle.
+	if (x & G.dmask)
+	    continue;
+	struct dp *e = insert(x, start, len);
+	if (e && e->start != start)
+	    resolve(e->start, e->len, start, len);
+    }
+    __atomic_add_fetch(&G.steps, steps, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&G.chains, chains, __ATOMIC_RELAXED);
+    return arg;
+}
+
+int main(int argc, char **argv)
+{
+    G.nthr = 2;
+    G.seed = rand64();
+    G.want = 1;
+    int bits = 64, dbits = 16, logsize = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:b:d:t:m:")) != -1)
+    switch (opt) {
+    case 'j':
+	G.nthr = atoi(optarg);
+	assert(G.nthr > 0);
+	break;
+    case 's':
+	G.seed = strtoull(optarg, NULL, 16);
+	break;
+    case 'b':
+	bits = atoi(optarg);
+	assert(bits >= 16 && bits <= 64);
+	break;
+    case 'd':
+	dbits = atoi(optarg);
+	assert(dbits >= 1 && dbits < 32);
+	break;
+    case 't':
+	logsize = atoi(optarg);
+	assert(logsize >= 10 && logsize <= 32);
+	break;
+    case 'm':
+	G.plen = strlen(optarg);
+	assert(G.plen < sizeof G.prefix);
+	memcpy(G.prefix, optarg, G.plen);
+	break;
+    default:
+	assert(!!!"getopt");
+    }
+    if (optind < argc) {
+	assert(optind + 1 == argc);
+	G.want = atoi(argv[optind]);
+	assert(G.want > 0);
+    }
+    assert(dbits < bits);
+    assert(G.plen + 16 >= MINLEN);
+
+    G.mask = UINT64_MAX >> (64 - bits);
+    G.dmask = (UINT64_C(1) << dbits) - 1;
+    G.maxlen = UINT64_C(20) << dbits;
+    G.dp = calloc((size_t) 1 << logsize, sizeof *G.dp);
+    assert(G.dp);
+    G.dpmask = ((size_t) 1 << logsize) - 1;
+    G.pairs = malloc(G.want * sizeof *G.pairs);
+    assert(G.pairs);
+
+    pthread_mutex_init(&G.mutex, NULL);
+    pthread_t *tid = malloc(G.nthr * sizeof *tid);
+    assert(tid);
+    for (int i = 0; i < G.nthr; i++) {
+	int rc = pthread_create(&tid[i], NULL, worker, NULL);
+	assert(rc == 0);
+    }
+    for (int i = 0; i < G.nthr; i++) {
+	int rc = pthread_join(tid[i], NULL);
+	assert(rc == 0);
+    }
+    fprintf(stderr, "%" PRIu64 " steps, %" PRIu64 " chains, %zu points stored, "
+	    "%" PRIu64 " pairs found again\n",
+	    G.steps, G.chains, G.dpfill, G.dups);
+    if (G.full)
+	fprintf(stderr, "the table is full after %d of %d pairs, try a larger -t or -d\n",
+		G.found, G.want);
+    free(tid);
+    free(G.pairs);
+    free(G.dp);
+    return G.found < G.want;
+}
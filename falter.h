@@ -0,0 +1,68 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Faltering multiplication counters.  The collisions come about when one
+// half of a multiplier is zero or small, so that the product loses the
+// difference.  With -DFALTER, the update kernels count, per lane, how often
+// a multiplier half is zero, or has at most one bit set (then the product
+// is merely a shift).  The counters are thread-local, no atomics involved.
+// Without FALTER, the macros compile to nothing.
+
+#pragma once
+
+#ifdef FALTER
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define FALTER_NLANE 4
+
+struct falter {
+    uint64_t n[FALTER_NLANE];
+    uint64_t zero[FALTER_NLANE];
+    uint64_t low[FALTER_NLANE];
+};
+
+static __thread struct falter falter;
+
+static inline void falter_count(int lane, uint32_t a, uint32_t b)
+{
+    falter.n[lane]++;
+    falter.zero[lane] += a == 0 || b == 0;
+    falter.low[lane] += (a & (a - 1)) == 0 || (b & (b - 1)) == 0;
+}
+
+static inline void falter_print(FILE *fp, const struct falter *f)
+{
+    for (int i = 0; i < FALTER_NLANE; i++)
+	if (f->n[i])
+	    fprintf(fp, " lane%d %" PRIu64 " zero %" PRIu64 " low %" PRIu64,
+		    i, f->n[i], f->zero[i], f->low[i]);
+}
+
+#define FALTER_MUL(lane, a, b) falter_count(lane, a, b)
+#define FALTER_RESET() memset(&falter, 0, sizeof falter)
+#define FALTER_SAVE(f) ((f) = falter)
+#else
+#define FALTER_MUL(lane, a, b) ((void) 0)
+#define FALTER_RESET() ((void) 0)
+#define FALTER_SAVE(f) ((void) 0)
+#endif
@@ -0,0 +1,251 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <stdio.h>
+#include <pthread.h>
+#include "gen.h"
+#include "errexit.h"
+
+// SplitMix64, seeded per string.
+static inline uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+struct rng { uint64_t s; };
+
+static inline uint64_t next(struct rng *r)
+{
+    return mix(r->s += UINT64_C(0x9e3779b97f4a7c15));
+}
+
+static inline struct rng rng(uint64_t seed, uint64_t i)
+{
+    return (struct rng) { mix(seed ^ mix(i + 1)) };
+}
+
+static inline uint32_t below(struct rng *r, uint32_t n)
+{
+    return (uint64_t)(uint32_t) next(r) * n >> 32;
+}
+
+// A generator writes the i-th string into buf and returns its length.
+typedef size_t (*genfunc)(uint64_t seed, uint32_t i, size_t minlen, char *buf);
+
+static size_t counter(uint64_t seed, uint32_t i, size_t minlen, char *buf)
+{
+    (void) seed;
+    int w = minlen > 4 ? minlen - 3 : 1;
+    return sprintf(buf, "sym%0*u", w, i);
+}
+
+// No generated string has a newline: collisions.c prints the strings
+// one per line, and so does the worker to the coordinator.
+static inline char nonl(unsigned c)
+{
+    return c == '\n' ? c ^ 0x80 : c;
+}
+
+// The zero-feeding weakness: the update state deteriorates as zero
+// blocks go in.  The layout is fixed per seed.  The index is written
+// in base 255, the digits skip the newline; 255^4 strings would not
+// fit in the slab anyway.
+static size_t zeroes(uint64_t seed, uint32_t i, size_t minlen, char *buf)
+{
+    struct rng r = rng(seed, UINT32_MAX);
+    size_t len = 32 + below(&r, 33);
+    if (len < minlen)
+	len = minlen;
+    memset(buf, 0, len);
+    size_t pos[4];
+    for (int k = 0; k < 4; k++, i /= 255) {
+    again:
+	pos[k] = below(&r, len);
+	for (int j = 0; j < k; j++)
+	    if (pos[j] == pos[k])
+		goto again;
+	buf[pos[k]] = i % 255 + (i % 255 >= '\n');
+    }
+    return len;
+}
+
+// The base string for a family of one-byte or one-block variations.
+static size_t base(uint64_t seed, uint32_t b, size_t minlen, char *buf)
+{
+    struct rng r = rng(~seed, b);
+    size_t len = 48;
+    if (len < minlen)
+	len = (minlen + 7) & ~7;
+    for (size_t j = 0; j < len; j++)
+	buf[j] = 'a' + below(&r, 26);
+    return len;
+}
+
+// Of the 255 flips of a byte, the one which makes a newline is replaced
+// with the flip by 255.
+static size_t onebyte(uint64_t seed, uint32_t i, size_t minlen, char *buf)
+{
+    size_t len = base(seed, 0, minlen, buf);
+    uint32_t per = len * 254;
+    len = base(seed, i / per, minlen, buf);
+    i %= per;
+    char *p = &buf[i % len];
+    unsigned v = 1 + i / len;
+    *p ^= (*p ^ v) == '\n' ? 255 : v;
+    return len;
+}
+
+static size_t oneblock(uint64_t seed, uint32_t i, size_t minlen, char *buf)
+{
+    size_t len = base(seed, 0, minlen, buf);
+    uint32_t per = len / 8 * 65536;
+    len = base(seed, i / per, minlen, buf);
+    struct rng r = rng(seed, i);
+    i %= per;
+    uint64_t x = next(&r);
+    char *p = buf + (i % (len / 8)) * 8;
+    memcpy(p, &x, 8);
+    for (int k = 0; k < 8; k++)
+	p[k] = nonl((unsigned char) p[k]);
+    return len;
+}
+
+static size_t mangled(uint64_t seed, uint32_t i, size_t minlen, char *buf)
+{
+    static const char *names[] = {
+	"QString", "QList", "QMap", "QHash", "Private", "Data", "Node",
+	"Iterator", "Interface", "Widget", "Model", "Item", "View",
+	"basic_string", "vector", "allocator", "pair", "map", "Impl",
+	"ClassBrowser", "Plugin", "Handler", "Manager", "Context",
+    };
+    static const char *types[] = {
+	"i", "j", "l", "m", "b", "c", "d", "Pv", "PKc", "RKS_",
+	"RK7QString", "S0_", "S1_", "PS0_", "OT_", "St6vectorIiSaIiEE",
+    };
+    struct rng r = rng(seed, i);
+    char *p = buf;
+    p += sprintf(p, "_ZN");
+    int depth = 1 + below(&r, 3);
+    for (int k = 0; k < depth; k++) {
+	const char *name = names[below(&r, sizeof names / sizeof *names)];
+	p += sprintf(p, "%zu%s", strlen(name), name);
+    }
+    // The index in a template argument makes each name unique.
+    p += sprintf(p, "ILi%uEE", i);
+    p += sprintf(p, "%s", below(&r, 2) ? "C1E" : "D2E");
+    int nparam = below(&r, 4);
+    if (nparam == 0)
+	*p++ = 'v';
+    for (int k = 0; k < nparam; k++)
+	p += sprintf(p, "%s", types[below(&r, sizeof types / sizeof *types)]);
+    while ((size_t)(p - buf) < minlen)
+	*p++ = '_';
+    return p - buf;
+}
+
+static const struct { const char *name; genfunc f; } gens[] = {
+    { "counter", counter },
+    { "zeroes", zeroes },
+    { "onebyte", onebyte },
+    { "oneblock", oneblock },
+    { "mangled", mangled },
+};
+
+// The strings are generated twice: first only to size each chunk, then
+// straight into the slab, at the offsets worked out from the sizes.
+struct chunk {
+    genfunc f;
+    uint64_t seed;
+    uint32_t lo, hi;
+    size_t minlen;
+    char *out; // NULL when sizing
+    size_t size;
+    pthread_t tid;
+};
+
+static void *genthread(void *arg)
+{
+    struct chunk *c = arg;
+    char *tmp = xmalloc(2 + 1024 + c->minlen);
+    size_t size = 0;
+    for (uint32_t i = c->lo; i < c->hi; i++) {
+	// The generators may put a NUL past the string, which must not land
+	// in the next chunk, so the last string goes through tmp.
+	char *p = c->out && i + 1 < c->hi ? c->out + size : tmp;
+	size_t len = c->f(c->seed, i, c->minlen, p + 2);
+	assert(len >= c->minlen && len <= 1024 + c->minlen);
+	uint16_t len16 = len;
+	memcpy(p, &len16, 2);
+	if (c->out && p == tmp)
+	    memcpy(c->out + size, tmp, 2 + len);
+	size += 2 + len;
+    }
+    free(tmp);
+    if (c->out)
+	assert(size == c->size);
+    c->size = size;
+    return arg;
+}
+
+static void run(struct chunk *cv, int nthr)
+{
+    for (int t = 0; t < nthr; t++) {
+	int rc = pthread_create(&cv[t].tid, NULL, genthread, &cv[t]);
+	assert(rc == 0);
+    }
+    for (int t = 0; t < nthr; t++) {
+	int rc = pthread_join(cv[t].tid, NULL);
+	assert(rc == 0);
+    }
+}
+
+void gen_fill(struct slab *slab, const char *name, uint32_t n, uint64_t seed,
+	size_t minlen, int nthr)
+{
+    genfunc f = NULL;
+    for (size_t i = 0; i < sizeof gens / sizeof *gens; i++)
+	if (strcmp(name, gens[i].name) == 0)
+	    f = gens[i].f;
+    if (!f)
+	die("%s: no such generator", name);
+    struct chunk *cv = xmalloc(nthr * sizeof *cv);
+    for (int t = 0; t < nthr; t++)
+	cv[t] = (struct chunk) {
+	    .f = f, .seed = seed, .minlen = minlen,
+	    .lo = (uint64_t) n * t / nthr,
+	    .hi = (uint64_t) n * (t + 1) / nthr,
+	};
+    run(cv, nthr);
+    size_t total = 0;
+    for (int t = 0; t < nthr; t++)
+	total += cv[t].size;
+    slab_reserve(slab, total);
+    char *out = (char *) slab_get(slab, slab->fill);
+    for (int t = 0; t < nthr; t++) {
+	cv[t].out = out;
+	out += cv[t].size;
+    }
+    run(cv, nthr);
+    slab->fill += total;
+    free(cv);
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Synthetic corpora, generated in parallel straight into the slab.
+// Each string depends only on the seed and its index, so the corpus
+// is the same regardless of the number of threads.
+//	counter		sym0001, sym0002, ...
+//	zeroes		zero bytes, with the index scattered over a few bytes
+//	onebyte		random strings which differ from a base in one byte
+//	oneblock	random strings which differ from a base in one 8-byte block
+//	mangled		C++ mangled names produced from a small grammar
+// None of the strings has a newline.
+
+#pragma once
+#include "slab.h"
+
+// Appends n strings to the slab, in the same layout that collisions.c
+// uses: a 16-bit length followed by the bytes.  The strings are at least
+// minlen bytes long.  Dies if there is no such generator.
+void gen_fill(struct slab *slab, const char *name, uint32_t n, uint64_t seed,
+	size_t minlen, int nthr);
@@ -18,6 +18,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "falter.h"
+
 // This is a scaled-down version of the original ZrHa_update construction.
 // Its drawback is that the mixing step is not reversible (e.g. it can be shown
 // that the state deteriorates slowly as you feed zeroes into it).
@@ -29,6 +31,8 @@ static inline void update(uint32_t state[2], const void *p)
     uint32_t x1 = state[1] + data[1];
     uint32_t m0 = (uint16_t) x0 * (x0 >> 16);
     uint32_t m1 = (uint16_t) x1 * (x1 >> 16);
+    FALTER_MUL(0, (uint16_t) x0, x0 >> 16);
+    FALTER_MUL(1, (uint16_t) x1, x1 >> 16);
     // The last combining step can be either ADD or XOR.  While ADD is slightly
     // worse than XOR at being non-invertible, it combats slightly better
     // small-bit deltas (which may occur when multiplication goes wrong).
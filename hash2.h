@@ -18,6 +18,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "falter.h"
+
 // This is a scaled-down version of the improved ZrHa_update2 construction
 // which works on two states.  The data is injected twice, and the mixing step
 // is reversible.
@@ -29,6 +31,8 @@ static inline void update2(uint32_t x[2], uint32_t y[2], const void *p)
     y[1] ^= d[1];
     uint32_t m0 = (uint16_t) y[0] * (y[0] >> 16);
     uint32_t m1 = (uint16_t) y[1] * (y[1] >> 16);
+    FALTER_MUL(0, (uint16_t) y[0], y[0] >> 16);
+    FALTER_MUL(1, (uint16_t) y[1], y[1] >> 16);
     x[0] += d[0];
     x[1] += d[1];
     m0 += rotl32(x[1], 16);
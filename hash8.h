@@ -18,6 +18,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "falter.h"
+
 static inline void Xor(uint16_t x[2], uint16_t a[2])
 {
     x[0] ^= a[0];
@@ -73,6 +75,10 @@ static inline void update(uint16_t x[2], uint16_t y[2], uint16_t dx[2], uint16_t
     mx[1] = (uint8_t) x[1] * (y[1] >> 8);
     my[0] = (uint8_t) y[0] * (x[1] >> 8);
     my[1] = (uint8_t) y[1] * (x[0] >> 8);
+    FALTER_MUL(0, (uint8_t) x[0], y[0] >> 8);
+    FALTER_MUL(1, (uint8_t) x[1], y[1] >> 8);
+    FALTER_MUL(2, (uint8_t) y[0], x[1] >> 8);
+    FALTER_MUL(3, (uint8_t) y[1], x[0] >> 8);
 #endif
     Shuf(y, SHUF0);
     F2(x, dy);
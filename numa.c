@@ -0,0 +1,190 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mman.h>
+#include <linux/mempolicy.h>
+#include "numa.h"
+#include "errexit.h"
+
+// Parse a cpulist like "0-3,8-11" into a bitmap.
+static void parse_cpulist(const char *s, bool *set, int max)
+{
+    while (*s && *s != '\n') {
+	char *end;
+	long lo = strtol(s, &end, 10), hi = lo;
+	if (end == s)
+	    break;
+	if (*end == '-')
+	    hi = strtol(end + 1, &end, 10);
+	for (long i = lo; i <= hi && i < max; i++)
+	    set[i] = true;
+	s = *end == ',' ? end + 1 : end;
+    }
+}
+
+static bool read_cpulist(const char *fname, bool *set, int max)
+{
+    FILE *fp = fopen(fname, "r");
+    if (!fp)
+	return false;
+    char buf[4096];
+    bool ok = fgets(buf, sizeof buf, fp);
+    fclose(fp);
+    if (ok)
+	parse_cpulist(buf, set, max);
+    return ok;
+}
+
+void numa_init(struct numa *numa)
+{
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof mask, &mask) < 0)
+	die("%s: sched_getaffinity: %m", __func__);
+    int max = CPU_SETSIZE;
+    numa->cpu = xmalloc(max * sizeof(int));
+    numa->node = xmalloc(max * sizeof(int));
+    numa->core = xmalloc(max * sizeof(int));
+    int ncore = 0;
+    numa->ncpu = 0;
+    numa->nnode = 0;
+    bool taken[CPU_SETSIZE] = { 0, };
+    for (int node = 0; ; node++) {
+	char fname[64];
+	bool set[CPU_SETSIZE] = { 0, };
+	sprintf(fname, "/sys/devices/system/node/node%d/cpulist", node);
+	bool single = false;
+	if (!read_cpulist(fname, set, max)) {
+	    if (node > 0)
+		break;
+	    // No NUMA info, treat the machine as a single node.
+	    for (int i = 0; i < max; i++)
+		set[i] = true;
+	    single = true;
+	}
+	numa->nnode++;
+	for (int i = 0; i < max; i++) {
+	    if (!set[i] || taken[i] || !CPU_ISSET(i, &mask))
+		continue;
+	    // Add the CPU along with its SMT siblings.
+	    bool sib[CPU_SETSIZE] = { 0, };
+	    sprintf(fname, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", i);
+	    sib[i] = true;
+	    read_cpulist(fname, sib, max);
+	    int ncpu = numa->ncpu;
+	    for (int j = 0; j < max; j++) {
+		if (!sib[j] || taken[j] || !set[j] || !CPU_ISSET(j, &mask))
+		    continue;
+		taken[j] = true;
+		numa->cpu[numa->ncpu] = j;
+		numa->node[numa->ncpu] = node;
+		numa->core[numa->ncpu] = ncore;
+		numa->ncpu++;
+	    }
+	    ncore += numa->ncpu > ncpu;
+	}
+	if (single)
+	    break;
+    }
+    if (numa->ncpu == 0)
+	die("%s: no CPUs", __func__);
+}
+
+void numa_fini(struct numa *numa)
+{
+    free(numa->cpu), numa->cpu = NULL;
+    free(numa->node), numa->node = NULL;
+    free(numa->core), numa->core = NULL;
+}
+
+void numa_pin(int cpu)
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if (sched_setaffinity(0, sizeof mask, &mask) < 0)
+	warn("%s: sched_setaffinity: %m", __func__);
+}
+
+static size_t page_size(int huge)
+{
+    if (huge == NUMA_1G)
+	return 1 << 30;
+    if (huge == NUMA_2M)
+	return 2 << 20;
+    return 4096;
+}
+
+// Huge pages are only used for allocations of at least one such page:
+// a small buffer should not take up a whole 1G page.
+static int fit_huge(size_t size, int huge)
+{
+    while (huge != NUMA_THP && size < page_size(huge))
+	huge = huge == NUMA_1G ? NUMA_2M : NUMA_THP;
+    return huge;
+}
+
+void *numa_alloc(size_t size, int node, int huge)
+{
+    huge = fit_huge(size, huge);
+    size_t psize = page_size(huge);
+    size = (size + psize - 1) & ~(psize - 1);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (huge == NUMA_1G)
+	flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+    else if (huge == NUMA_2M)
+	flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED && huge != NUMA_THP) {
+	static bool warned;
+	if (!__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED))
+	    warn("%s: no huge pages reserved, falling back to THP", __func__);
+	flags &= ~(MAP_HUGETLB | MAP_HUGE_1GB | MAP_HUGE_2MB);
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	huge = NUMA_THP;
+    }
+    if (p == MAP_FAILED)
+	die("%s: mmap: %m", __func__);
+    if (huge == NUMA_THP)
+	madvise(p, size, MADV_HUGEPAGE);
+    if (node >= 0) {
+	unsigned long mask[16] = { 0, };
+	assert(node < 16 * 64);
+	mask[node / 64] = 1UL << node % 64;
+	// Must be called before the pages are touched.
+	if (syscall(SYS_mbind, p, size, MPOL_BIND, mask, 16 * 64, 0) < 0)
+	    warn("%s: mbind: %m", __func__);
+    }
+    return p;
+}
+
+void numa_free(void *p, size_t size, int huge)
+{
+    huge = fit_huge(size, huge);
+    size_t psize = page_size(huge);
+    size = (size + psize - 1) & ~(psize - 1);
+    munmap(p, size);
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// NUMA topology and placement helpers: which CPUs belong to which node,
+// pinning threads to CPUs, and allocating node-local memory (optionally
+// backed by huge pages).  Implemented with raw syscalls, no libnuma.
+
+#pragma once
+#include <stddef.h>
+
+struct numa {
+    int nnode;
+    int ncpu;
+    // CPUs ordered node by node, with SMT siblings kept next to each other.
+    int *cpu;
+    int *node;
+    int *core; // the physical core, numbered across the nodes
+};
+
+void numa_init(struct numa *numa);
+void numa_fini(struct numa *numa);
+
+// Pin the calling thread to a CPU.
+void numa_pin(int cpu);
+
+// Huge page policy for numa_alloc.
+enum { NUMA_THP, NUMA_2M, NUMA_1G };
+
+// Allocate memory on a node (node < 0 means anywhere).  The memory is
+// zero-filled and should be released with numa_free.
+void *numa_alloc(size_t size, int node, int huge);
+void numa_free(void *p, size_t size, int huge);
@@ -0,0 +1,153 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pairmap.h"
+#include "errexit.h"
+
+void pairmap_init(struct pairmap *pm, int logsize)
+{
+    size_t size = (size_t) 1 << logsize;
+    // Big enough to be mmapped, so the pages which are never
+    // touched cost nothing.
+    pm->key = calloc(size, sizeof *pm->key);
+    pm->cnt = calloc(size, sizeof *pm->cnt);
+    if (!pm->key || !pm->cnt)
+	die("%s: %m", __func__);
+    pm->mask = size - 1;
+    pm->fill = 0;
+    pm->evicted = 0;
+    pm->floor = 1;
+    pthread_rwlock_init(&pm->lock, NULL);
+}
+
+void pairmap_fini(struct pairmap *pm)
+{
+    free(pm->key), pm->key = NULL;
+    free(pm->cnt), pm->cnt = NULL;
+    pthread_rwlock_destroy(&pm->lock);
+}
+
+// Returns false if the table is full.
+static bool insert(struct pairmap *pm, uint64_t key, uint32_t n)
+{
+    size_t i = (key * UINT64_C(0x9E3779B97F4A7C15)) >> 20;
+    while (1) {
+	i &= pm->mask;
+	uint64_t k = __atomic_load_n(&pm->key[i], __ATOMIC_ACQUIRE);
+	if (k == 0) {
+	    // Keep the table at most 3/4 full, so that probing stays short.
+	    size_t fill = __atomic_add_fetch(&pm->fill, 1, __ATOMIC_RELAXED);
+	    if (fill > pm->mask / 4 * 3) {
+		__atomic_sub_fetch(&pm->fill, 1, __ATOMIC_RELAXED);
+		return false;
+	    }
+	    if (__atomic_compare_exchange_n(&pm->key[i], &k, key, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		break;
+	    // Another thread took the slot.
+	    __atomic_sub_fetch(&pm->fill, 1, __ATOMIC_RELAXED);
+	}
+	if (k == key)
+	    break;
+	i++;
+    }
+    __atomic_add_fetch(&pm->cnt[i], n, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Rebuilds the table without the pairs below the lowest count which leaves
+// the table at most half full.  Called under the write lock.
+static void evict(struct pairmap *pm)
+{
+    uint64_t *key = pm->key;
+    uint32_t *cnt = pm->cnt;
+    size_t size = pm->mask + 1;
+    uint32_t min = 1;
+    size_t keep;
+    do {
+	min++;
+	keep = 0;
+	for (size_t i = 0; i < size; i++)
+	    keep += key[i] && cnt[i] >= min;
+    } while (keep > size / 2);
+    if (pm->floor < min)
+	pm->floor = min;
+    pm->key = calloc(size, sizeof *pm->key);
+    pm->cnt = calloc(size, sizeof *pm->cnt);
+    if (!pm->key || !pm->cnt)
+	die("%s: %m", __func__);
+    pm->evicted += pm->fill - keep;
+    pm->fill = 0;
+    for (size_t i = 0; i < size; i++)
+	if (key[i] && cnt[i] >= min)
+	    insert(pm, key[i], cnt[i]);
+    free(key);
+    free(cnt);
+}
+
+void pairmap_addn(struct pairmap *pm, uint32_t so1, uint32_t so2, uint32_t n)
+{
+    if (so1 > so2) {
+	uint32_t so = so1;
+	so1 = so2, so2 = so;
+    }
+    uint64_t key = (uint64_t) so1 << 32 | so2;
+    while (1) {
+	pthread_rwlock_rdlock(&pm->lock);
+	bool done = insert(pm, key, n);
+	pthread_rwlock_unlock(&pm->lock);
+	if (done)
+	    return;
+	pthread_rwlock_wrlock(&pm->lock);
+	// Another thread may have evicted already.
+	if (pm->fill >= pm->mask / 4 * 3)
+	    evict(pm);
+	pthread_rwlock_unlock(&pm->lock);
+    }
+}
+
+static int cmp(const void *p1, const void *p2)
+{
+    const struct pairent *e1 = p1, *e2 = p2;
+    if (e1->cnt != e2->cnt)
+	return e1->cnt > e2->cnt ? -1 : 1;
+    if (e1->so1 != e2->so1)
+	return e1->so1 < e2->so1 ? -1 : 1;
+    return (e1->so2 > e2->so2) - (e1->so2 < e2->so2);
+}
+
+size_t pairmap_top(const struct pairmap *pm, uint32_t min, struct pairent **out)
+{
+    size_t n = 0, alloc = 0;
+    struct pairent *v = NULL;
+    for (size_t i = 0; i <= pm->mask; i++) {
+	if (pm->key[i] == 0 || pm->cnt[i] < min)
+	    continue;
+	if (n == alloc) {
+	    alloc = 2 * alloc + 256;
+	    v = xrealloc(v, alloc * sizeof *v);
+	}
+	v[n++] = (struct pairent) { pm->key[i] >> 32, (uint32_t) pm->key[i], pm->cnt[i] };
+    }
+    qsort(v, n, sizeof *v, cmp);
+    *out = v;
+    return n;
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// A concurrent map from string pairs to the number of seeds under which
+// the pair has collided.  Pairs which keep colliding under different seeds
+// indicate a structural weakness, as opposed to random birthday collisions.
+// The map is a lock-free open-addressing table with linear probing;
+// the strings are identified by their slab offsets.  When the table gets
+// full, the pairs with the lowest counts (birthday collisions, mostly)
+// are evicted, which takes the lock exclusively.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+struct pairmap {
+    uint64_t *key; // so1 << 32 | so2, so1 < so2; 0 means empty
+    uint32_t *cnt;
+    size_t mask;
+    size_t fill;
+    size_t evicted; // pairs evicted because the map was full
+    uint32_t floor; // the pairs with lower counts may have been evicted
+    pthread_rwlock_t lock;
+};
+
+void pairmap_init(struct pairmap *pm, int logsize);
+void pairmap_fini(struct pairmap *pm);
+
+// Adds n to the count of the pair, thread-safe.
+void pairmap_addn(struct pairmap *pm, uint32_t so1, uint32_t so2, uint32_t n);
+
+static inline void pairmap_add(struct pairmap *pm, uint32_t so1, uint32_t so2)
+{
+    pairmap_addn(pm, so1, so2, 1);
+}
+
+struct pairent {
+    uint32_t so1, so2;
+    uint32_t cnt;
+};
+
+// Returns the pairs seen at least min times, the most frequent first.
+// The result should be freed.
+size_t pairmap_top(const struct pairmap *pm, uint32_t min, struct pairent **out);
@@ -0,0 +1,327 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "shard.h"
+#include "errexit.h"
+
+static int inet_socket(const char *addr, bool passive)
+{
+    const char *colon = strrchr(addr, ':');
+    if (!colon)
+	die("%s: expected host:port", addr);
+    char host[256];
+    size_t hlen = colon - addr;
+    if (hlen >= sizeof host)
+	die("%s: host name too long", addr);
+    memcpy(host, addr, hlen), host[hlen] = '\0';
+    struct addrinfo hints = {
+	.ai_family = AF_UNSPEC,
+	.ai_socktype = SOCK_STREAM,
+	.ai_flags = passive ? AI_PASSIVE : 0,
+    };
+    struct addrinfo *ai;
+    int rc = getaddrinfo(hlen ? host : NULL, colon + 1, &hints, &ai);
+    if (rc)
+	die("%s: %s", addr, gai_strerror(rc));
+    int fd = -1;
+    for (struct addrinfo *p = ai; p; p = p->ai_next) {
+	fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+	if (fd < 0)
+	    continue;
+	if (passive) {
+	    int one = 1;
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+	    if (bind(fd, p->ai_addr, p->ai_addrlen) == 0)
+		break;
+	}
+	else if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+	    break;
+	close(fd), fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd < 0)
+	die("%s: %s: %m", addr, passive ? "bind" : "connect");
+    return fd;
+}
+
+static int unix_socket(const char *addr, bool passive)
+{
+    struct sockaddr_un sun = { .sun_family = AF_UNIX };
+    if (strlen(addr) >= sizeof sun.sun_path)
+	die("%s: path too long", addr);
+    strcpy(sun.sun_path, addr);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+	die("%s: socket: %m", addr);
+    if (passive) {
+	unlink(addr);
+	if (bind(fd, (struct sockaddr *) &sun, sizeof sun) < 0)
+	    die("%s: bind: %m", addr);
+    }
+    else if (connect(fd, (struct sockaddr *) &sun, sizeof sun) < 0)
+	die("%s: connect: %m", addr);
+    return fd;
+}
+
+int shard_listen(const char *addr)
+{
+    int fd = strchr(addr, '/') ? unix_socket(addr, true) : inet_socket(addr, true);
+    if (listen(fd, 64) < 0)
+	die("%s: listen: %m", addr);
+    return fd;
+}
+
+int shard_connect(const char *addr)
+{
+    return strchr(addr, '/') ? unix_socket(addr, false) : inet_socket(addr, false);
+}
+
+// A range of trials handed out to a worker, along with the results
+// which are held back until the range is done.
+struct range {
+    uint64_t lo, hi;
+    struct range *next;
+    char *out;
+    size_t len, alloc;
+    uint64_t ntrial, ncoll, nhit;
+};
+
+struct client {
+    int fd;
+    bool waiting;
+    char *buf;
+    size_t fill, alloc;
+    struct range *ranges;
+};
+
+static struct {
+    uint64_t ntry, batch, seed;
+    uint64_t next;	// the next trial index to hand out
+    uint64_t ndone;	// trials done, in completed ranges
+    struct range *requeue;
+    struct client *cv;
+    int nc;
+    shard_handler handler;
+    // the summary
+    uint64_t ncoll, nhit;
+    int nlost;
+} C;
+
+static void drop(int i, bool lost)
+{
+    struct client *c = &C.cv[i];
+    struct range *r = c->ranges;
+    while (r) {
+	struct range *next = r->next;
+	free(r->out);
+	*r = (struct range) { .lo = r->lo, .hi = r->hi, .next = C.requeue };
+	C.requeue = r;
+	r = next;
+    }
+    if (c->ranges)
+	warn("worker lost, its ranges will be reassigned");
+    C.nlost += lost;
+    close(c->fd);
+    free(c->buf);
+    C.cv[i] = C.cv[--C.nc];
+}
+
+static struct range *find(struct client *c, uint64_t lo, struct range ***pprev)
+{
+    struct range **prev = &c->ranges;
+    for (struct range *r = *prev; r; prev = &r->next, r = r->next)
+	if (r->lo == lo) {
+	    if (pprev)
+		*pprev = prev;
+	    return r;
+	}
+    die("range %" PRIu64 " not found", lo);
+}
+
+static void process(struct client *c, char *line, size_t len)
+{
+    uint64_t lo, i, n;
+    char *end;
+    switch (*line) {
+    case 'G':
+	c->waiting = true;
+	break;
+    case 'C': {
+	lo = strtoull(line + 2, &end, 10);
+	struct range *r = find(c, lo, NULL);
+	end++, len -= end - line;
+	if (r->len + len + 1 > r->alloc) {
+	    r->alloc = 2 * (r->len + len + 1);
+	    r->out = xrealloc(r->out, r->alloc);
+	}
+	memcpy(r->out + r->len, end, len);
+	r->len += len;
+	r->out[r->len++] = '\n';
+	break; }
+    case 'T': {
+	if (sscanf(line + 2, "%" SCNu64 " %" SCNu64 " %" SCNu64, &lo, &i, &n) != 3)
+	    die("bad line: %.*s", (int) len, line);
+	struct range *r = find(c, lo, NULL);
+	assert(i >= r->lo && i < r->hi);
+	r->ntrial++;
+	r->ncoll += n;
+	r->nhit += n > 0;
+	break; }
+    case 'D': {
+	struct range **prev;
+	struct range *r = find(c, strtoull(line + 2, NULL, 10), &prev);
+	if (r->ntrial != r->hi - r->lo)
+	    die("range %" PRIu64 ": %" PRIu64 " trials missing", r->lo, r->hi - r->lo - r->ntrial);
+	fwrite(r->out, 1, r->len, stdout);
+	fflush(stdout);
+	C.ndone += r->ntrial;
+	C.ncoll += r->ncoll;
+	C.nhit += r->nhit;
+	*prev = r->next;
+	free(r->out);
+	free(r);
+	break; }
+    default:
+	if (!C.handler || !C.handler(line, len))
+	    die("bad line: %.*s", (int) len, line);
+    }
+}
+
+// Returns false if the client has gone.
+static bool input(struct client *c)
+{
+    if (c->alloc - c->fill < 4096) {
+	c->alloc = 2 * c->alloc + 65536;
+	c->buf = xrealloc(c->buf, c->alloc);
+    }
+    ssize_t n = read(c->fd, c->buf + c->fill, c->alloc - c->fill);
+    if (n <= 0)
+	return false;
+    c->fill += n;
+    char *p = c->buf, *end = c->buf + c->fill, *nl;
+    while ((nl = memchr(p, '\n', end - p))) {
+	process(c, p, nl - p);
+	p = nl + 1;
+    }
+    c->fill = end - p;
+    memmove(c->buf, p, c->fill);
+    return true;
+}
+
+static bool reply(struct client *c, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static bool reply(struct client *c, const char *fmt, ...)
+{
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+    return write(c->fd, buf, len) == len;
+}
+
+// Hands out a range to a waiting client.  Returns false if the client
+// has gone.
+static bool serve(struct client *c)
+{
+    struct range *r = C.requeue;
+    if (r)
+	C.requeue = r->next;
+    else if (C.next < C.ntry) {
+	r = xmalloc(sizeof *r);
+	uint64_t hi = C.next + C.batch < C.ntry ? C.next + C.batch : C.ntry;
+	*r = (struct range) { .lo = C.next, .hi = hi };
+	C.next = hi;
+    }
+    else
+	return true;
+    r->next = c->ranges;
+    c->ranges = r;
+    c->waiting = false;
+    return reply(c, "R %" PRIu64 " %" PRIu64 " %016" PRIx64 "\n", r->lo, r->hi, C.seed);
+}
+
+uint64_t shard_coordinate(int lfd, uint64_t ntry, uint64_t batch, uint64_t seed,
+	shard_handler handler)
+{
+    signal(SIGPIPE, SIG_IGN);
+    C.ntry = ntry, C.batch = batch, C.seed = seed;
+    C.handler = handler;
+    struct pollfd *pfd = NULL;
+    int nalloc = 0;
+    while (C.ndone < C.ntry) {
+	if (C.nc + 1 > nalloc) {
+	    nalloc = 2 * nalloc + 16;
+	    C.cv = xrealloc(C.cv, nalloc * sizeof *C.cv);
+	    pfd = xrealloc(pfd, (nalloc + 1) * sizeof *pfd);
+	}
+	pfd[0] = (struct pollfd) { .fd = lfd, .events = POLLIN };
+	for (int i = 0; i < C.nc; i++)
+	    pfd[i+1] = (struct pollfd) { .fd = C.cv[i].fd, .events = POLLIN };
+	int nc = C.nc;
+	if (poll(pfd, nc + 1, -1) < 0)
+	    die("poll: %m");
+	// Clients are dropped by swapping with the last one,
+	// so go backwards.
+	for (int i = nc - 1; i >= 0; i--)
+	    if (pfd[i+1].revents && !input(&C.cv[i]))
+		drop(i, true);
+	if (pfd[0].revents & POLLIN) {
+	    int fd = accept(lfd, NULL, NULL);
+	    if (fd >= 0)
+		C.cv[C.nc++] = (struct client) { .fd = fd };
+	}
+	for (int i = C.nc - 1; i >= 0; i--)
+	    if (C.cv[i].waiting && !serve(&C.cv[i]))
+		drop(i, true);
+    }
+    // Let the workers finish, and collect their last lines.
+    for (int i = C.nc - 1; i >= 0; i--)
+	if (!reply(&C.cv[i], "E\n"))
+	    drop(i, false);
+    while (C.nc > 0) {
+	for (int i = 0; i < C.nc; i++)
+	    pfd[i] = (struct pollfd) { .fd = C.cv[i].fd, .events = POLLIN };
+	int nc = C.nc;
+	if (poll(pfd, nc, -1) < 0)
+	    die("poll: %m");
+	for (int i = nc - 1; i >= 0; i--)
+	    if (pfd[i].revents && !input(&C.cv[i]))
+		drop(i, false);
+    }
+    free(pfd);
+    free(C.cv);
+    fprintf(stderr, "%" PRIu64 " trials, %" PRIu64 " colliding strings, "
+	    "%" PRIu64 " trials with collisions, %d workers lost\n",
+	    C.ndone, C.ncoll, C.nhit, C.nlost);
+    return C.ndone;
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Seed-space sharding: a coordinator hands out ranges of trial indices
+// to worker processes over a Unix or TCP socket, and collects the results.
+// The seed for trial i is derived from the campaign seed, so each trial
+// is run exactly once no matter which worker gets it.
+//
+// The protocol is line-based.  Worker to coordinator:
+//	G			get a range
+//	C <lo> <line>		a collision line from the range starting at lo
+//	T <lo> <i> <ncoll>	trial i done, with ncoll colliding strings
+//	D <lo>			the range starting at lo is done
+// Coordinator to worker:
+//	R <lo> <hi> <seed>	trials [lo, hi) under the campaign seed
+//	E			no more ranges, exit
+// The results for a range are held back until the range is done; if the
+// worker dies, the range is handed out again.  After E, the coordinator
+// waits for the workers to hang up; any other lines they send (e.g. the
+// totals over all their trials) are passed to the caller's handler.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The address is either a path (with a slash) to a Unix socket,
+// or host:port for TCP.
+int shard_listen(const char *addr);
+int shard_connect(const char *addr);
+
+// Runs the coordinator until all ntry trials are done; collision lines
+// go to stdout, and the summary goes to stderr.  The handler, unless NULL,
+// returns false if the line is not recognized.  Returns the number of trials
+// done.
+typedef bool (*shard_handler)(const char *line, size_t len);
+uint64_t shard_coordinate(int lfd, uint64_t ntry, uint64_t batch, uint64_t seed,
+	shard_handler handler);
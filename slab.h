@@ -22,6 +22,7 @@
 // Objects are identified by their 32-bit offset (or "position") in the slab.
 // Poistion 0 is reserved, and may serve as NULL.
 
+#pragma once
 #include "platform.h"
 
 struct slab {
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/auxv.h>
+#include "falter.h"
 
 static __uint128_t rand64state;
 
@@ -50,6 +51,10 @@ static inline void updateA(uint32_t x[2], uint32_t y[2])
     mx[1] = (uint16_t) x[1] * (x[1] >> 16);
     my[0] = (uint16_t) y[0] * (y[0] >> 16);
     my[1] = (uint16_t) y[1] * (y[1] >> 16);
+    FALTER_MUL(0, (uint16_t) x[0], x[0] >> 16);
+    FALTER_MUL(1, (uint16_t) x[1], x[1] >> 16);
+    FALTER_MUL(2, (uint16_t) y[0], y[0] >> 16);
+    FALTER_MUL(3, (uint16_t) y[1], y[1] >> 16);
     mx[0] += rotl32(x[1], 16);
     mx[1] += rotl32(x[0], 16);
     my[0] += rotl32(y[1], 16);
@@ -66,6 +71,7 @@ static inline unsigned try(__uint128_t seed,
     uint32_t x[4];
     memcpy(x, &seed, 16);
     uint32_t i = 0;
+    FALTER_RESET();
     do {
 	int same;
 	uint32_t a[4];
@@ -89,6 +95,10 @@ int main(int argc, char **argv)
 	uint64_t seed1 = rand64();
 	__uint128_t seed = seed0 | (__uint128_t) seed1 << 64;
 	unsigned n = try(seed, updateA);
-	printf("%016lx%016lx\t%u\n", seed1, seed0, n);
+	printf("%016lx%016lx\t%u", seed1, seed0, n);
+#ifdef FALTER
+	falter_print(stdout, &falter);
+#endif
+	putchar('\n');
     }
 }
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/auxv.h>
+#include "falter.h"
 
 static __uint128_t rand64state;
 
@@ -53,6 +54,10 @@ static inline void updateA(uint16_t x[2], uint16_t y[2])
     mx[1] = (uint8_t) x[1] * (x[1] >> 8);
     my[0] = (uint8_t) y[0] * (y[0] >> 8);
     my[1] = (uint8_t) y[1] * (y[1] >> 8);
+    FALTER_MUL(0, (uint8_t) x[0], x[0] >> 8);
+    FALTER_MUL(1, (uint8_t) x[1], x[1] >> 8);
+    FALTER_MUL(2, (uint8_t) y[0], y[0] >> 8);
+    FALTER_MUL(3, (uint8_t) y[1], y[1] >> 8);
     mx[0] += rotl16(x[1], 8);
     mx[1] += rotl16(x[0], 8);
     my[0] += y[1];
@@ -73,6 +78,10 @@ static inline void updateB(uint16_t x[2], uint16_t y[2])
     mx[1] = (uint8_t) x[1] * (y[1] >> 8);
     my[0] = (uint8_t) y[0] * (x[0] >> 8);
     my[1] = (uint8_t) y[1] * (x[1] >> 8);
+    FALTER_MUL(0, (uint8_t) x[0], y[0] >> 8);
+    FALTER_MUL(1, (uint8_t) x[1], y[1] >> 8);
+    FALTER_MUL(2, (uint8_t) y[0], x[0] >> 8);
+    FALTER_MUL(3, (uint8_t) y[1], x[1] >> 8);
     mx[0] += rotl16(x[1], 8);
     mx[1] += rotl16(x[0], 8);
     my[0] += y[1];
@@ -92,6 +101,10 @@ static inline void updateC(uint16_t x[2], uint16_t y[2])
     mx[1] = (uint8_t) x[1] * (y[1] >> 8);
     my[0] = (uint8_t) y[0] * (x[1] >> 8);
     my[1] = (uint8_t) y[1] * (x[0] >> 8);
+    FALTER_MUL(0, (uint8_t) x[0], y[0] >> 8);
+    FALTER_MUL(1, (uint8_t) x[1], y[1] >> 8);
+    FALTER_MUL(2, (uint8_t) y[0], x[1] >> 8);
+    FALTER_MUL(3, (uint8_t) y[1], x[0] >> 8);
     mx[0] += rotl16(x[1], 8);
     mx[1] += rotl16(x[0], 8);
     my[0] += y[1];
@@ -108,6 +121,7 @@ static inline unsigned try(uint64_t seed, uint32_t imax,
     uint16_t x[4];
     memcpy(x, &seed, 8);
     uint32_t i = 0;
+    FALTER_RESET();
     while (1) {
 	int same;
 	uint16_t a[4];
@@ -149,6 +163,10 @@ int main(int argc, char **argv)
 	    n = try(seed, 1<<28, updateB);
 	else
 	    n = try(seed, 1<<29, updateC);
-	printf("%016lx\t%u\n", seed, n);
+	printf("%016lx\t%u", seed, n);
+#ifdef FALTER
+	falter_print(stdout, &falter);
+#endif
+	putchar('\n');
     }
 }
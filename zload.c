@@ -0,0 +1,469 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The input is decompressed by producer threads into chunks, and the main
+// thread parses the chunks, in order, into the slab as they become ready.
+// A gzip or zstd stream is decompressed by a single producer, overlapping
+// with the parsing.  When the input is a regular file which consists of
+// many independent frames (zstd frames with the content size, e.g. by pzstd,
+// or BGZF gzip members, e.g. by bgzip), the frames are decompressed
+// in parallel, one frame per chunk.
+
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef ZLIB
+#include <zlib.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+#include "zload.h"
+#include "errexit.h"
+
+enum { F_PLAIN, F_GZIP, F_ZSTD };
+
+// Chunk i goes to slot i % nslot; a producer waits until the slot is free.
+#define CHUNK (4 << 20)
+
+struct slot {
+    uchar *buf;
+    size_t len, alloc;
+    bool full;
+};
+
+struct frame {
+    size_t off, size;
+    size_t out; // decompressed size
+};
+
+struct zq {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct slot *slot;
+    size_t nslot;
+    size_t head;   // the next chunk to parse
+    size_t nchunk; // the number of chunks, once done
+    bool done;
+    int fmt;
+    // The input stream, with the bytes peeked to detect the format.
+    int fd;
+    uchar peek[16];
+    size_t npeek, ppeek;
+    // The input file, split into frames.
+    const uchar *map;
+    size_t mapsize;
+    struct frame *frame;
+    size_t nframe, next;
+};
+
+static struct slot *slot_get(struct zq *q, size_t i, size_t size)
+{
+    pthread_mutex_lock(&q->mutex);
+    while (i >= q->head + q->nslot)
+	pthread_cond_wait(&q->cond, &q->mutex);
+    pthread_mutex_unlock(&q->mutex);
+    struct slot *s = &q->slot[i % q->nslot];
+    // An empty frame, e.g. the EOF member of BGZF, still needs a buffer:
+    // inflate() rejects a NULL next_out.
+    if (size == 0)
+	size = 1;
+    if (s->alloc < size) {
+	free(s->buf);
+	s->buf = xmalloc(size);
+	s->alloc = size;
+    }
+    return s;
+}
+
+static void slot_put(struct zq *q, struct slot *s, size_t len)
+{
+    pthread_mutex_lock(&q->mutex);
+    s->len = len;
+    s->full = true;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static void finish(struct zq *q, size_t nchunk)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->nchunk = nchunk;
+    q->done = true;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// Reads up to n bytes from the stream, less only at EOF.
+static size_t src_read(struct zq *q, void *buf, size_t n)
+{
+    size_t k = q->npeek - q->ppeek;
+    if (k > n)
+	k = n;
+    memcpy(buf, q->peek + q->ppeek, k);
+    q->ppeek += k;
+    while (k < n) {
+	ssize_t ret = read(q->fd, buf + k, n - k);
+	if (ret < 0)
+	    die("%s: %m", __func__);
+	if (ret == 0)
+	    break;
+	k += ret;
+    }
+    return k;
+}
+
+static void *serial(void *arg)
+{
+    struct zq *q = arg;
+    size_t i = 0;
+    if (q->fmt == F_PLAIN) {
+	while (1) {
+	    struct slot *s = slot_get(q, i, CHUNK);
+	    size_t n = src_read(q, s->buf, CHUNK);
+	    if (n == 0)
+		break;
+	    slot_put(q, s, n), i++;
+	    if (n < CHUNK)
+		break;
+	}
+    }
+#ifdef ZLIB
+    else if (q->fmt == F_GZIP) {
+	uchar *in = xmalloc(1 << 20);
+	z_stream z = { 0, };
+	if (inflateInit2(&z, 15 + 16) != Z_OK)
+	    die("%s: inflateInit2 failed", __func__);
+	bool eof = false, end = false;
+	while (!end) {
+	    struct slot *s = slot_get(q, i, CHUNK);
+	    z.next_out = s->buf;
+	    z.avail_out = CHUNK;
+	    while (z.avail_out && !end) {
+		if (z.avail_in == 0 && !eof) {
+		    z.next_in = in;
+		    z.avail_in = src_read(q, in, 1 << 20);
+		    eof = z.avail_in < 1 << 20;
+		}
+		int rc = inflate(&z, Z_NO_FLUSH);
+		if (rc == Z_STREAM_END) {
+		    // Concatenated members.
+		    if (z.avail_in == 0 && eof)
+			end = true;
+		    else
+			inflateReset(&z);
+		}
+		else if (rc == Z_BUF_ERROR && z.avail_in == 0 && eof)
+		    die("%s: truncated gzip input", __func__);
+		else if (rc != Z_OK && rc != Z_BUF_ERROR)
+		    die("%s: inflate: %s", __func__, z.msg ? z.msg : "error");
+	    }
+	    size_t n = CHUNK - z.avail_out;
+	    if (n)
+		slot_put(q, s, n), i++;
+	}
+	inflateEnd(&z);
+	free(in);
+    }
+#endif
+#ifdef ZSTD
+    else if (q->fmt == F_ZSTD) {
+	uchar *in = xmalloc(1 << 20);
+	ZSTD_DCtx *dctx = ZSTD_createDCtx();
+	if (!dctx)
+	    die("%s: ZSTD_createDCtx failed", __func__);
+	ZSTD_inBuffer zin = { in, 0, 0 };
+	bool eof = false;
+	size_t ret = 0;
+	while (1) {
+	    struct slot *s = slot_get(q, i, CHUNK);
+	    ZSTD_outBuffer zout = { s->buf, CHUNK, 0 };
+	    while (zout.pos < zout.size) {
+		if (zin.pos == zin.size) {
+		    if (eof)
+			break;
+		    zin.size = src_read(q, in, 1 << 20);
+		    zin.pos = 0;
+		    eof = zin.size < 1 << 20;
+		    continue;
+		}
+		ret = ZSTD_decompressStream(dctx, &zout, &zin);
+		if (ZSTD_isError(ret))
+		    die("%s: %s", __func__, ZSTD_getErrorName(ret));
+	    }
+	    if (zout.pos)
+		slot_put(q, s, zout.pos), i++;
+	    if (zout.pos < zout.size)
+		break;
+	}
+	// Zero means that the last frame is complete.
+	if (ret)
+	    die("%s: truncated zstd input", __func__);
+	ZSTD_freeDCtx(dctx);
+	free(in);
+    }
+#endif
+    finish(q, i);
+    return NULL;
+}
+
+static inline uint32_t le16(const uchar *p) { return p[0] | p[1] << 8; }
+static inline uint32_t le32(const uchar *p) { return le16(p) | le16(p + 2) << 16; }
+
+static void add_frame(struct zq *q, size_t off, size_t size, size_t out)
+{
+    if (q->nframe % 1024 == 0)
+	q->frame = xrealloc(q->frame, (q->nframe + 1024) * sizeof *q->frame);
+    q->frame[q->nframe++] = (struct frame) { off, size, out };
+}
+
+// A BGZF member has the "BC" extra subfield with the member's size.
+static size_t bgzf_size(const uchar *p, size_t n)
+{
+    if (n < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+	return 0;
+    size_t xlen = le16(p + 10);
+    if (12 + xlen > n)
+	return 0;
+    for (size_t k = 12; k + 4 <= 12 + xlen; k += 4 + le16(p + k + 2))
+	if (p[k] == 'B' && p[k+1] == 'C' && le16(p + k + 2) == 2) {
+	    size_t size = le16(p + k + 4) + 1;
+	    return size <= n && size >= 12 + xlen + 8 ? size : 0;
+	}
+    return 0;
+}
+
+// Splits the mapped input into independent frames.  Returns false
+// if the input cannot be split, and should be decompressed as a stream.
+static bool split(struct zq *q)
+{
+    const uchar *p = q->map;
+    size_t off = 0, n = q->mapsize;
+    while (off < n) {
+	size_t size = 0, out = 0;
+	if (q->fmt == F_GZIP) {
+	    size = bgzf_size(p + off, n - off);
+	    if (size)
+		out = le32(p + off + size - 4);
+	}
+#ifdef ZSTD
+	else if (q->fmt == F_ZSTD) {
+	    size = ZSTD_findFrameCompressedSize(p + off, n - off);
+	    if (ZSTD_isError(size))
+		size = 0;
+	    else {
+		unsigned long long csize = ZSTD_getFrameContentSize(p + off, size);
+		if (csize == ZSTD_CONTENTSIZE_UNKNOWN || csize == ZSTD_CONTENTSIZE_ERROR)
+		    size = 0;
+		else
+		    out = csize;
+	    }
+	}
+#endif
+	if (size == 0) {
+	    q->nframe = 0;
+	    return false;
+	}
+	add_frame(q, off, size, out);
+	off += size;
+    }
+    return q->nframe > 1;
+}
+
+static void *framed(void *arg)
+{
+    struct zq *q = arg;
+#ifdef ZLIB
+    z_stream z = { 0, };
+    if (q->fmt == F_GZIP && inflateInit2(&z, 15 + 16) != Z_OK)
+	die("%s: inflateInit2 failed", __func__);
+#endif
+#ifdef ZSTD
+    ZSTD_DCtx *dctx = NULL;
+    if (q->fmt == F_ZSTD && !(dctx = ZSTD_createDCtx()))
+	die("%s: ZSTD_createDCtx failed", __func__);
+#endif
+    while (1) {
+	pthread_mutex_lock(&q->mutex);
+	size_t i = q->next++;
+	pthread_mutex_unlock(&q->mutex);
+	if (i >= q->nframe)
+	    break;
+	const struct frame *f = &q->frame[i];
+	struct slot *s = slot_get(q, i, f->out);
+	const uchar *src = q->map + f->off;
+#ifdef ZLIB
+	if (q->fmt == F_GZIP) {
+	    inflateReset(&z);
+	    z.next_in = (uchar *) src;
+	    z.avail_in = f->size;
+	    z.next_out = s->buf;
+	    z.avail_out = f->out;
+	    int rc = inflate(&z, Z_FINISH);
+	    if (rc != Z_STREAM_END || z.avail_out || z.avail_in)
+		die("%s: bad BGZF member at %zu", __func__, f->off);
+	}
+#endif
+#ifdef ZSTD
+	if (q->fmt == F_ZSTD) {
+	    size_t ret = ZSTD_decompressDCtx(dctx, s->buf, f->out, src, f->size);
+	    if (ZSTD_isError(ret))
+		die("%s: %s", __func__, ZSTD_getErrorName(ret));
+	    if (ret != f->out)
+		die("%s: bad zstd frame at %zu", __func__, f->off);
+	}
+#endif
+	(void) src;
+	slot_put(q, s, f->out);
+    }
+#ifdef ZLIB
+    if (q->fmt == F_GZIP)
+	inflateEnd(&z);
+#endif
+#ifdef ZSTD
+    ZSTD_freeDCtx(dctx);
+#endif
+    return NULL;
+}
+
+// A line may span chunks; its head is kept in the carry buffer.
+struct carry {
+    uchar buf[UINT16_MAX];
+    size_t len;
+    bool skip;
+};
+
+static inline void emit(struct slab *slab, const uchar *p, size_t len, size_t minlen, uint32_t *nstr)
+{
+    if (len < minlen || len > UINT16_MAX)
+	return;
+    slab_reserve(slab, 2 + len);
+    uint16_t len16 = len;
+    slab_copy(slab, &len16, 2);
+    slab_copy(slab, p, len);
+    ++*nstr;
+}
+
+static void parse(struct slab *slab, const uchar *p, size_t n, struct carry *c,
+	size_t minlen, uint32_t *nstr)
+{
+    const uchar *end = p + n;
+    while (p < end) {
+	const uchar *nl = memchr(p, '\n', end - p);
+	const uchar *e = nl ? nl : end;
+	if (nl && c->len == 0 && !c->skip)
+	    emit(slab, p, nl - p, minlen, nstr);
+	else {
+	    if (c->len + (e - p) > sizeof c->buf)
+		c->skip = true;
+	    else
+		memcpy(c->buf + c->len, p, e - p), c->len += e - p;
+	    if (nl) {
+		if (!c->skip)
+		    emit(slab, c->buf, c->len, minlen, nstr);
+		c->len = 0, c->skip = false;
+	    }
+	}
+	p = nl ? nl + 1 : end;
+    }
+}
+
+uint32_t zload(struct slab *slab, int fd, size_t minlen, int nthr)
+{
+    struct zq q = { .fd = fd };
+    pthread_mutex_init(&q.mutex, NULL);
+    pthread_cond_init(&q.cond, NULL);
+    q.npeek = src_read(&q, q.peek, 4);
+    q.ppeek = 0;
+    if (q.npeek >= 2 && q.peek[0] == 0x1f && q.peek[1] == 0x8b)
+	q.fmt = F_GZIP;
+    else if (q.npeek == 4 && (le32(q.peek) == 0xFD2FB528 ||
+		(le32(q.peek) & ~0xF) == 0x184D2A50)) // or a skippable frame
+	q.fmt = F_ZSTD;
+#ifndef ZLIB
+    if (q.fmt == F_GZIP)
+	die("%s: gzip input, rebuild with -DZLIB", __func__);
+#endif
+#ifndef ZSTD
+    if (q.fmt == F_ZSTD)
+	die("%s: zstd input, rebuild with -DZSTD", __func__);
+#endif
+
+    // A compressed regular file is mapped, to look for frames.
+    struct stat st;
+    if (q.fmt != F_PLAIN && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED) {
+	    q.map = map;
+	    q.mapsize = st.st_size;
+	}
+    }
+    bool par = q.map && split(&q);
+    int nt = par ? nthr : 1;
+    q.nslot = par ? 4 * nthr + 16 : 16;
+    q.slot = xmalloc(q.nslot * sizeof *q.slot);
+    memset(q.slot, 0, q.nslot * sizeof *q.slot);
+    if (par) {
+	q.nchunk = q.nframe;
+	q.done = true;
+    }
+    pthread_t tid[nt];
+    for (int i = 0; i < nt; i++) {
+	int rc = pthread_create(&tid[i], NULL, par ? framed : serial, &q);
+	if (rc)
+	    die("%s: pthread_create: %s", __func__, strerror(rc));
+    }
+
+    struct carry *c = xmalloc(sizeof *c);
+    c->len = 0, c->skip = false;
+    uint32_t nstr = 0;
+    for (size_t i = 0; ; i++) {
+	struct slot *s = &q.slot[i % q.nslot];
+	pthread_mutex_lock(&q.mutex);
+	while (!s->full && !(q.done && i >= q.nchunk))
+	    pthread_cond_wait(&q.cond, &q.mutex);
+	pthread_mutex_unlock(&q.mutex);
+	if (!s->full)
+	    break;
+	parse(slab, s->buf, s->len, c, minlen, &nstr);
+	pthread_mutex_lock(&q.mutex);
+	s->full = false;
+	q.head++;
+	pthread_cond_broadcast(&q.cond);
+	pthread_mutex_unlock(&q.mutex);
+    }
+    if (c->len || c->skip)
+	die("%s: no newline at the end of input", __func__);
+
+    for (int i = 0; i < nt; i++)
+	pthread_join(tid[i], NULL);
+    for (size_t i = 0; i < q.nslot; i++)
+	free(q.slot[i].buf);
+    free(q.slot);
+    free(c);
+    free(q.frame);
+    if (q.map)
+	munmap((void *) q.map, q.mapsize);
+    pthread_cond_destroy(&q.cond);
+    pthread_mutex_destroy(&q.mutex);
+    return nstr;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <assert.h>
+#include "zrha.h"
+// The AVX2 kernel is compiled in regardless of the flags, and the batch
+// call only uses it if the CPU has AVX2.
+#if defined(__x86_64__) && !defined(__AVX2__)
+#define ZRHA64_AVX2 __attribute__((target("avx2")))
+#endif
+#include "zrha64.h"
+
+static_assert(sizeof(struct zrha64_ctx) <= sizeof(struct zrha_state), "");
+static_assert(_Alignof(struct zrha64_ctx) <= _Alignof(struct zrha_state), "");
+
+uint64_t zrha_hash(const void *data, size_t len, uint64_t seed)
+{
+    return zrha64_hash(data, len, seed);
+}
+
+void zrha_init(struct zrha_state *st, uint64_t seed)
+{
+    zrha64_init((struct zrha64_ctx *) st, seed);
+}
+
+void zrha_update(struct zrha_state *st, const void *data, size_t len)
+{
+    zrha64_update((struct zrha64_ctx *) st, data, len);
+}
+
+uint64_t zrha_final(const struct zrha_state *st)
+{
+    return zrha64_final((const struct zrha64_ctx *) st);
+}
+
+void zrha_hash_batch(const void *const *data, const size_t *len, size_t n,
+	uint64_t seed, uint64_t *out)
+{
+    size_t i = 0;
+#ifdef ZRHA64_AVX2
+    if (__builtin_cpu_supports("avx2"))
+	for (; i + 2 <= n; i += 2)
+	    zrha64_hash_x2(data[i], len[i], data[i+1], len[i+1], seed, out + i);
+#endif
+    for (; i < n; i++)
+	out[i] = zrha64_hash(data[i], len[i], seed);
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The library interface to the full-width ZrHa64 (see zrha64.h), for use
+// outside of this research code.  The functions are stable; the hash
+// values are those of zrha64_hash.  The Makefile builds it as a static
+// and a shared library.  On x86-64, the batch call picks the AVX2 kernel
+// at run time, and falls back to SSE2, one message at a time.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZRHA_API __attribute__((visibility("default")))
+
+// Hashes a single message.
+ZRHA_API uint64_t zrha_hash(const void *data, size_t len, uint64_t seed);
+
+// The streaming interface: any split of the input gives the same result
+// as zrha_hash.  The state is opaque, and can live on the stack.
+struct zrha_state {
+    uint64_t opaque[18];
+} __attribute__((aligned(16)));
+
+ZRHA_API void zrha_init(struct zrha_state *st, uint64_t seed);
+ZRHA_API void zrha_update(struct zrha_state *st, const void *data, size_t len);
+ZRHA_API uint64_t zrha_final(const struct zrha_state *st);
+
+// Hashes n messages under the same seed: out[i] = zrha_hash(data[i], len[i], seed).
+// Two messages go through the AVX2 kernel at once; messages of similar
+// lengths next to each other make the best of it.
+ZRHA_API void zrha_hash_batch(const void *const *data, const size_t *len, size_t n,
+	uint64_t seed, uint64_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,276 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks zrha64.h against the portable reference and against the
+// scaled-down model in hash2.h, then measures the throughput.
+//
+//	gcc -O2 -march=native -Wall -o zrha64 zrha64.c
+//
+// The SSE2 and AVX2 code paths are checked against the reference code,
+// the streaming interface is checked against the one-shot hash with random
+// splits, and the reference update2 instantiated with 32-bit lanes must
+// match update2 from hash2.h.  The known answers pin down the reference
+// itself: they must only change along with the definition of the hash.
+//
+// Measured with -b on a Xeon server core, -O2 -march=native (AVX2): long
+// messages at 9.3 GB/s, 18.4 GB/s with hash_x2, and 11-15 ns per hash
+// for 8- to 64-byte keys.  The SSE2 build is about the same, except that
+// hash_x2 does not help there.  With -b, the throughput is measured for
+// long messages (GB/s) and for short keys (ns per hash).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+
+static inline uint32_t rotl32(uint32_t x, int k) { return x << k | x >> (32 - k); }
+static inline uint64_t rotr64(uint64_t x, int k) { return x >> k | x << (64 - k); }
+
+static inline uint64_t rrmxmx(uint64_t x)
+{
+    x ^= rotr64(x, 49) ^ rotr64(x, 24);
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    return x;
+}
+
+#define hash __attribute__((unused)) hash2
+#include "hash2.h"
+#undef hash
+#undef MINLEN
+#include "zrha64.h"
+
+static __uint128_t rand64state;
+
+static __attribute__((constructor)) void rand64init(void)
+{
+    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
+    rand64state |= 1;
+}
+
+static inline uint64_t rand64(void)
+{
+    uint64_t ret = rand64state >> 64;
+    rand64state *= 0xda942042e4dd58b5;
+    return ret;
+}
+
+static void randfill(void *buf, size_t n)
+{
+    unsigned char *p = buf;
+    for (size_t i = 0; i < n; i++)
+	p[i] = rand64() >> 56;
+}
+
+// The whole hash written out with the reference update2 and plain arrays.
+static uint64_t refhash(const void *data, size_t len, uint64_t seed)
+{
+    uint64_t s[6] = {
+	seed, seed ^ UINT64_C(0x9E3779B97F4A7C15),
+	seed, seed ^ UINT64_C(0x9E3779B97F4A7C15),
+	seed, seed ^ UINT64_C(0x9E3779B97F4A7C15),
+    };
+    if (len < 16) {
+	char buf[16] = { 0, };
+	memcpy(buf, data, len);
+	zrha64_update2_ref(s + 0, s + 2, buf);
+    }
+    else {
+	const void *end = data + len;
+	while (end - data > 48) {
+	    zrha64_update2_ref(s + 0, s + 2, data + 0);
+	    zrha64_update2_ref(s + 2, s + 4, data + 16);
+	    zrha64_update2_ref(s + 4, s + 0, data + 32);
+	    data += 48;
+	}
+	if (end - data > 16)
+	    zrha64_update2_ref(s + 0, s + 2, data), data += 16;
+	if (end - data > 16)
+	    zrha64_update2_ref(s + 2, s + 4, data), data += 16;
+	// The last block goes after the blocks consumed so far.
+	int k = (len - 1) % 48 / 16;
+	zrha64_update2_ref(s + 2 * k, s + 2 * (k + 1) % 6, end - 16);
+    }
+    uint64_t xlen = len * UINT64_C(6364136223846793005);
+    return (zrha64_mix(s[0] ^ s[3]) ^ xlen) + (zrha64_mix(s[2] ^ s[5]) ^ zrha64_mix(s[4] ^ s[1]));
+}
+
+static int nfail;
+
+#define CHECK(cond, ...)					\
+    do {							\
+	if (!(cond)) {						\
+	    fprintf(stderr, "FAIL %s: ", #cond);		\
+	    fprintf(stderr, __VA_ARGS__);			\
+	    fputc('\n', stderr);				\
+	    nfail++;						\
+	}							\
+    } while (0)
+
+static void check_model(void)
+{
+    for (int i = 0; i < 1 << 16; i++) {
+	uint32_t x[2] = { rand64(), rand64() }, y[2] = { rand64(), rand64() };
+	uint32_t x1[2] = { x[0], x[1] }, y1[2] = { y[0], y[1] };
+	uint32_t d[2] = { rand64(), rand64() };
+	update2(x, y, d);
+	ZRHA_UPDATE2_REF(uint32_t, uint16_t, x1, y1, d);
+	CHECK(memcmp(x, x1, 8) == 0 && memcmp(y, y1, 8) == 0,
+		"update2 %08" PRIx32 " %08" PRIx32, d[0], d[1]);
+    }
+}
+
+static void check_hash(void)
+{
+    enum { MAXLEN = 512 };
+    unsigned char buf[MAXLEN + 16];
+    for (int iter = 0; iter < 64; iter++) {
+	uint64_t seed = rand64();
+	randfill(buf, sizeof buf);
+	for (size_t len = 0; len <= MAXLEN; len++) {
+	    // Unaligned, to exercise loadu.
+	    const void *p = buf + (len & 15);
+	    uint64_t h = refhash(p, len, seed);
+	    CHECK(zrha64_hash(p, len, seed) == h, "hash len=%zu", len);
+	    struct zrha64_ctx c;
+	    zrha64_init(&c, seed);
+	    size_t off = 0;
+	    while (off < len) {
+		size_t n = rand64() % (len - off + 1);
+		if (rand64() & 1)
+		    n %= 20;
+		zrha64_update(&c, p + off, n);
+		off += n;
+	    }
+	    CHECK(zrha64_final(&c) == h, "stream len=%zu", len);
+	    size_t len1 = rand64() % (MAXLEN + 1);
+	    uint64_t hx[2];
+	    zrha64_hash_x2(p, len, buf, len1, seed, hx);
+	    CHECK(hx[0] == h && hx[1] == refhash(buf, len1, seed),
+		    "x2 len=%zu,%zu", len, len1);
+	}
+    }
+}
+
+// The bytes are i*131+7, the seed is 0123456789abcdef.
+static const struct { size_t len; uint64_t h; } kat[] = {
+    {    0, UINT64_C(0x8fbbfc72d2829137) },
+    {    1, UINT64_C(0xfeb4f9a7cdda5dfa) },
+    {   15, UINT64_C(0x5ee408e5565f72b0) },
+    {   16, UINT64_C(0x35fbf249602b444f) },
+    {   31, UINT64_C(0xbee66a14f3addfe5) },
+    {   32, UINT64_C(0xd0523decc242767f) },
+    {   33, UINT64_C(0xcf4e78996731772d) },
+    {   64, UINT64_C(0x82be673b93c29786) },
+    { 1000, UINT64_C(0x4f16d3753dbc9ed6) },
+};
+
+static void check_kat(void)
+{
+    unsigned char buf[1000];
+    for (size_t i = 0; i < sizeof buf; i++)
+	buf[i] = i * 131 + 7;
+    const uint64_t seed = UINT64_C(0x0123456789abcdef);
+    for (size_t i = 0; i < sizeof kat / sizeof *kat; i++) {
+	size_t len = kat[i].len;
+	CHECK(refhash(buf, len, seed) == kat[i].h, "kat ref len=%zu", len);
+	CHECK(zrha64_hash(buf, len, seed) == kat[i].h, "kat len=%zu", len);
+    }
+}
+
+static inline uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void bench(void)
+{
+    size_t size = 1 << 20;
+    unsigned char *buf = malloc(size + 64);
+    assert(buf);
+    randfill(buf, size + 64);
+    uint64_t sum = 0;
+    int n = 1 << 10;
+    uint64_t t0 = now();
+    for (int i = 0; i < n; i++)
+	sum += zrha64_hash(buf, size, i);
+    uint64_t t1 = now();
+    for (int i = 0; i < n; i += 2) {
+	uint64_t h[2];
+	zrha64_hash_x2(buf, size, buf + 16, size, i, h);
+	sum += h[0] + h[1];
+    }
+    uint64_t t2 = now();
+    printf("long\t%.2f GB/s\tx2 %.2f GB/s\n",
+	    (double) size * n / (t1 - t0), (double) size * n / (t2 - t1));
+    for (size_t len = 8; len <= 64; len *= 2) {
+	n = 1 << 22;
+	t0 = now();
+	for (int i = 0; i < n; i++)
+	    sum += zrha64_hash(buf + (i & 1023), len, i);
+	t1 = now();
+	printf("len=%zu\t%.2f ns\n", len, (double) (t1 - t0) / n);
+    }
+    fprintf(stderr, "# %016" PRIx64 "\n", sum);
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    bool b = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b")) != -1)
+    switch (opt) {
+    case 'b':
+	b = true;
+	break;
+    default:
+	assert(!!!"getopt");
+    }
+    assert(optind == argc);
+
+    check_model();
+    check_kat();
+    check_hash();
+#if defined(__AVX2__)
+    const char *isa = "avx2";
+#elif defined(__SSE2__)
+    const char *isa = "sse2";
+#else
+    const char *isa = "c";
+#endif
+    if (nfail) {
+	fprintf(stderr, "%s: %d checks failed\n", isa, nfail);
+	return 1;
+    }
+    printf("%s: ok\n", isa);
+    if (b)
+	bench();
+    return 0;
+}
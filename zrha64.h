@@ -0,0 +1,330 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// This is the full-width ZrHa64, with the improved update2 construction of
+// which hash2.h is a scaled-down model: the lanes are 64 bits instead of 32,
+// and the multiplication is 32x32->64 (_mm_mul_epu32) instead of 16x16->32.
+// There are three states, each state being a 128-bit SIMD register with two
+// lanes, so 48 bytes are consumed per round.  Like in hash2.h, the last
+// block is read at the end of the input and may overlap with the previous
+// block.  The final mixing uses the same known-good step as the models.
+//
+// Besides the one-shot zrha64_hash, there is a streaming interface (init,
+// update, final) which gives the same results for any split of the input,
+// and zrha64_hash_x2, which hashes two messages at once with AVX2.
+// The portable C code is the reference; SSE2 and AVX2 are used if enabled.
+// To get the AVX2 code without -mavx2, e.g. for dispatching at run time,
+// define ZRHA64_AVX2 as __attribute__((target("avx2"))); zrha64_hash_x2
+// then must only be called if the CPU supports AVX2.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__) && !defined(ZRHA64_AVX2)
+#define ZRHA64_AVX2
+#endif
+#if defined(ZRHA64_AVX2) && defined(__SSE2__)
+#include <immintrin.h>
+#define ZRHA64_X2 ZRHA64_AVX2
+#else
+#define ZRHA64_X2
+#endif
+
+// The reference update2, for any lane width: T is the lane type, and H is
+// the type of its lower half.  With T = uint32_t and H = uint16_t, this is
+// exactly update2 from hash2.h.
+#define ZRHA_UPDATE2_REF(T, H, x, y, d)				\
+    do {							\
+	y[0] ^= d[0];						\
+	y[1] ^= d[1];						\
+	T m0 = (T)(H) y[0] * (y[0] >> 4 * sizeof(T));		\
+	T m1 = (T)(H) y[1] * (y[1] >> 4 * sizeof(T));		\
+	x[0] += d[0];						\
+	x[1] += d[1];						\
+	m0 += x[1] << 4 * sizeof(T) | x[1] >> 4 * sizeof(T);	\
+	m1 += x[0] << 4 * sizeof(T) | x[0] >> 4 * sizeof(T);	\
+	x[0] = m0;						\
+	x[1] = m1;						\
+    } while (0)
+
+static inline void zrha64_update2_ref(uint64_t x[2], uint64_t y[2], const void *p)
+{
+    uint64_t d[2];
+    memcpy(d, p, 16);
+    ZRHA_UPDATE2_REF(uint64_t, uint32_t, x, y, d);
+}
+
+#ifdef __SSE2__
+typedef __m128i zrha64_v;
+
+static inline void zrha64_update2v(zrha64_v *x, zrha64_v *y, __m128i d)
+{
+    *y = _mm_xor_si128(*y, d);
+    __m128i m = _mm_mul_epu32(*y, _mm_srli_epi64(*y, 32));
+    *x = _mm_add_epi64(*x, d);
+    // Swap the lanes and rotate each lane by 32 bits: reverse the dwords.
+    *x = _mm_add_epi64(m, _mm_shuffle_epi32(*x, _MM_SHUFFLE(0, 1, 2, 3)));
+}
+
+static inline void zrha64_update2(zrha64_v *x, zrha64_v *y, const void *p)
+{
+    zrha64_update2v(x, y, _mm_loadu_si128(p));
+}
+
+static inline zrha64_v zrha64_set(uint64_t lo, uint64_t hi)
+{
+    return _mm_set_epi64x(hi, lo);
+}
+
+static inline void zrha64_get(zrha64_v v, uint64_t x[2])
+{
+    _mm_storeu_si128((void *) x, v);
+}
+#else
+typedef struct { uint64_t x[2]; } zrha64_v;
+
+static inline void zrha64_update2v(zrha64_v *x, zrha64_v *y, zrha64_v d)
+{
+    ZRHA_UPDATE2_REF(uint64_t, uint32_t, x->x, y->x, d.x);
+}
+
+static inline void zrha64_update2(zrha64_v *x, zrha64_v *y, const void *p)
+{
+    zrha64_update2_ref(x->x, y->x, p);
+}
+
+static inline zrha64_v zrha64_set(uint64_t lo, uint64_t hi)
+{
+    return (zrha64_v) {{ lo, hi }};
+}
+
+static inline void zrha64_get(zrha64_v v, uint64_t x[2])
+{
+    x[0] = v.x[0], x[1] = v.x[1];
+}
+#endif
+
+static inline void zrha64_seed(zrha64_v s[3], uint64_t seed)
+{
+    // The lanes must differ, or else the state is symmetric
+    // under the lane swap.
+    s[0] = s[1] = s[2] = zrha64_set(seed, seed ^ UINT64_C(0x9E3779B97F4A7C15));
+}
+
+// Full rounds, while more than one round of input is left.
+static inline const void *zrha64_rounds(zrha64_v s[3], const void *data, size_t *len)
+{
+    while (*len > 48) {
+	zrha64_update2(&s[0], &s[1], data + 0);
+	zrha64_update2(&s[1], &s[2], data + 16);
+	zrha64_update2(&s[2], &s[0], data + 32);
+	data += 48, *len -= 48;
+    }
+    return data;
+}
+
+static inline uint64_t zrha64_load64(const void *p)
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return x;
+}
+
+static inline uint32_t zrha64_load32(const void *p)
+{
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+// Inputs shorter than 16 bytes are zero-padded.  The block is assembled
+// in registers: copying into a buffer and loading it back as a whole
+// defeats store forwarding.
+static inline zrha64_v zrha64_short(const unsigned char *p, size_t len)
+{
+    uint64_t lo = 0, hi = 0;
+    if (len > 8) {
+	lo = zrha64_load64(p);
+	hi = zrha64_load64(p + len - 8) >> (8 * (16 - len));
+    }
+    else if (len >= 4) {
+	lo = zrha64_load32(p);
+	lo |= (uint64_t) zrha64_load32(p + len - 4) >> (8 * (8 - len)) << 32;
+    }
+    else if (len > 0) {
+	lo = p[0];
+	lo |= (uint64_t) p[len / 2] << (8 * (len / 2));
+	lo |= (uint64_t) p[len - 1] << (8 * (len - 1));
+    }
+    return zrha64_set(lo, hi);
+}
+
+// The last 1..48 bytes of the input (or fewer if the input is short).
+// With 16 bytes or more in total, the last block can reach back.
+static inline void zrha64_tail(zrha64_v s[3], const void *data, size_t len, size_t total)
+{
+    if (total < 16) {
+	zrha64_update2v(&s[0], &s[1], zrha64_short(data, len));
+	return;
+    }
+    const void *last16 = data + len - 16;
+    if (len <= 16)
+	zrha64_update2(&s[0], &s[1], last16);
+    else if (len <= 32) {
+	zrha64_update2(&s[0], &s[1], data + 0);
+	zrha64_update2(&s[1], &s[2], last16);
+    }
+    else {
+	zrha64_update2(&s[0], &s[1], data + 0);
+	zrha64_update2(&s[1], &s[2], data + 16);
+	zrha64_update2(&s[2], &s[0], last16);
+    }
+}
+
+static inline uint64_t zrha64_mix(uint64_t x)
+{
+    x ^= (x >> 49 | x << 15) ^ (x >> 24 | x << 40);
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    return x;
+}
+
+static inline uint64_t zrha64_fold(const zrha64_v s[3], size_t total)
+{
+    uint64_t a[2], b[2], c[2];
+    zrha64_get(s[0], a);
+    zrha64_get(s[1], b);
+    zrha64_get(s[2], c);
+    uint64_t xlen = total * UINT64_C(6364136223846793005);
+    return (zrha64_mix(a[0] ^ b[1]) ^ xlen) + (zrha64_mix(b[0] ^ c[1]) ^ zrha64_mix(c[0] ^ a[1]));
+}
+
+static inline uint64_t zrha64_hash(const void *data, size_t len, uint64_t seed)
+{
+    zrha64_v s[3];
+    zrha64_seed(s, seed);
+    size_t n = len;
+    data = zrha64_rounds(s, data, &n);
+    zrha64_tail(s, data, n, len);
+    return zrha64_fold(s, len);
+}
+
+// The streaming interface.  The buffer holds the last 16 bytes which
+// have been consumed, followed by up to 48 pending bytes; the pending
+// bytes are consumed only when more input arrives.
+struct zrha64_ctx {
+    zrha64_v s[3];
+    uint64_t total;
+    size_t fill;
+    unsigned char buf[64];
+};
+
+static inline void zrha64_init(struct zrha64_ctx *c, uint64_t seed)
+{
+    zrha64_seed(c->s, seed);
+    c->total = 0;
+    c->fill = 0;
+}
+
+static inline void zrha64_update(struct zrha64_ctx *c, const void *data, size_t len)
+{
+    c->total += len;
+    if (c->fill + len <= 48) {
+	memcpy(c->buf + 16 + c->fill, data, len);
+	c->fill += len;
+	return;
+    }
+    size_t k = 48 - c->fill;
+    memcpy(c->buf + 16 + c->fill, data, k);
+    data += k, len -= k;
+    size_t n = 48 + 1;
+    zrha64_rounds(c->s, c->buf + 16, &n);
+    memcpy(c->buf, c->buf + 48, 16);
+    if (len > 48) {
+	data = zrha64_rounds(c->s, data, &len);
+	memcpy(c->buf, data - 16, 16);
+    }
+    memcpy(c->buf + 16, data, len);
+    c->fill = len;
+}
+
+static inline uint64_t zrha64_final(const struct zrha64_ctx *c)
+{
+    zrha64_v s[3] = { c->s[0], c->s[1], c->s[2] };
+    zrha64_tail(s, c->buf + 16, c->fill, c->total);
+    return zrha64_fold(s, c->total);
+}
+
+#if defined(ZRHA64_AVX2) && defined(__SSE2__)
+// Two messages side by side, one in each 128-bit half.
+static inline ZRHA64_X2 void zrha64_update2_x2(__m256i *x, __m256i *y, const void *p0, const void *p1)
+{
+    __m256i d = _mm256_loadu2_m128i(p1, p0);
+    *y = _mm256_xor_si256(*y, d);
+    __m256i m = _mm256_mul_epu32(*y, _mm256_srli_epi64(*y, 32));
+    *x = _mm256_add_epi64(*x, d);
+    *x = _mm256_add_epi64(m, _mm256_shuffle_epi32(*x, _MM_SHUFFLE(0, 1, 2, 3)));
+}
+#endif
+
+// Hashes two messages at once, as far as they both have full rounds.
+static inline ZRHA64_X2 void zrha64_hash_x2(const void *data0, size_t len0,
+	const void *data1, size_t len1, uint64_t seed, uint64_t h[2])
+{
+    zrha64_v s0[3], s1[3];
+    zrha64_seed(s0, seed);
+    zrha64_seed(s1, seed);
+    size_t n0 = len0, n1 = len1;
+#if defined(ZRHA64_AVX2) && defined(__SSE2__)
+    if (n0 > 48 && n1 > 48) {
+	__m256i s[3];
+	for (int i = 0; i < 3; i++)
+	    s[i] = _mm256_set_m128i(s1[i], s0[i]);
+	do {
+	    zrha64_update2_x2(&s[0], &s[1], data0 + 0, data1 + 0);
+	    zrha64_update2_x2(&s[1], &s[2], data0 + 16, data1 + 16);
+	    zrha64_update2_x2(&s[2], &s[0], data0 + 32, data1 + 32);
+	    data0 += 48, n0 -= 48;
+	    data1 += 48, n1 -= 48;
+	} while (n0 > 48 && n1 > 48);
+	for (int i = 0; i < 3; i++) {
+	    s0[i] = _mm256_castsi256_si128(s[i]);
+	    s1[i] = _mm256_extracti128_si256(s[i], 1);
+	}
+    }
+#endif
+    data0 = zrha64_rounds(s0, data0, &n0);
+    data1 = zrha64_rounds(s1, data1, &n1);
+    zrha64_tail(s0, data0, n0, len0);
+    zrha64_tail(s1, data1, n1, len1);
+    h[0] = zrha64_fold(s0, len0);
+    h[1] = zrha64_fold(s1, len1);
+}
+
+// For collisions.c, which includes the construction with INC.
+static inline uint64_t hash(const void *data, size_t len, uint64_t seed)
+{
+    return zrha64_hash(data, len, seed);
+}
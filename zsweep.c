@@ -0,0 +1,313 @@
+// Copyright (c) 2021 Alexey Tourbin
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// A design sweep over the state-collapse constructions of zeroes8.c and
+// zeroes16.c.  The update is parameterised by:
+//	MX	the multiplier of x[i]: x[i] itself, y[i], y[1-i], or x[1-i]
+//	MY	the multiplier of y[i]: y[i] itself, x[i], x[1-i], or y[1-i]
+//	R	which of the four cross terms are rotated by half a lane
+//		(bit 0: x[1] into mx[0], bit 1: x[0] into mx[1],
+//		 bit 2: y[1] into my[0], bit 3: y[0] into my[1])
+//	OP	how the cross terms are combined, ADD or XOR
+// With R written bit 0 first, updateA in zeroes8.c is (x y 1101 +), updateB is
+// (y x 1101 +), and updateC is (y x' 1101 +), x' meaning the other lane.
+// Each combination is instantiated as a separate function, the parameters
+// being compile-time constants, with the X-macros below, which make the full
+// cross product of the parameters (512 variants).  With -DBITS=16,
+// the lanes are 32-bit, as in zeroes16.c; the default is 16-bit lanes.
+//
+// The seeds are the same for all variants.  The work is split into chunks
+// of a few seeds for one variant, so that all threads are kept busy even
+// when only a few variants are left.  The variants are run with
+// successive halving: after each round, the better half (by the median
+// number of updates before the collapse) gets twice as many seeds, until
+// only -k variants are left.
+//
+//	gcc -O2 -Wall -o zsweep zsweep.c -lpthread
+//	gcc -O2 -Wall -DBITS=16 -o zsweep16 zsweep.c -lpthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/auxv.h>
+
+#ifndef BITS
+#define BITS 8
+#endif
+
+#if BITS == 8
+typedef uint16_t lane_t;
+typedef uint8_t half_t;
+#else
+typedef uint32_t lane_t;
+typedef uint16_t half_t;
+#endif
+
+static inline uint64_t rotr64(uint64_t x, int k) { return x >> k | x << (64 - k); }
+
+// A known-good mixing step, by Pelle Evensen.
+static inline uint64_t rrmxmx(uint64_t x)
+{
+    x ^= rotr64(x, 49) ^ rotr64(x, 24);
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    x *= UINT64_C(0x9FB21C651E98DF25);
+    x ^= x >> 28;
+    return x;
+}
+
+static __uint128_t rand64state;
+
+static __attribute__((constructor)) void rand64init(void)
+{
+    memcpy(&rand64state, (void *) getauxval(AT_RANDOM), 16);
+    rand64state |= 1;
+}
+
+static inline uint64_t rand64(void)
+{
+    uint64_t ret = rand64state >> 64;
+    rand64state *= 0xda942042e4dd58b5;
+    return ret;
+}
+
+static inline lane_t rot(lane_t x, bool on)
+{
+    return on ? (lane_t)(x << BITS | x >> BITS) : x;
+}
+
+static inline lane_t comb(lane_t a, lane_t b, int op)
+{
+    return op ? a ^ b : a + b;
+}
+
+static inline __attribute__((always_inline))
+void update(lane_t x[2], lane_t y[2], const int MX, const int MY, const int R, const int OP)
+{
+    lane_t px0 = MX == 0 ? x[0] : MX == 1 ? y[0] : MX == 2 ? y[1] : x[1];
+    lane_t px1 = MX == 0 ? x[1] : MX == 1 ? y[1] : MX == 2 ? y[0] : x[0];
+    lane_t py0 = MY == 0 ? y[0] : MY == 1 ? x[0] : MY == 2 ? x[1] : y[1];
+    lane_t py1 = MY == 0 ? y[1] : MY == 1 ? x[1] : MY == 2 ? x[0] : y[0];
+    lane_t mx[2], my[2];
+    mx[0] = (half_t) x[0] * (px0 >> BITS);
+    mx[1] = (half_t) x[1] * (px1 >> BITS);
+    my[0] = (half_t) y[0] * (py0 >> BITS);
+    my[1] = (half_t) y[1] * (py1 >> BITS);
+    mx[0] = comb(mx[0], rot(x[1], R & 1), OP);
+    mx[1] = comb(mx[1], rot(x[0], R & 2), OP);
+    my[0] = comb(my[0], rot(y[1], R & 4), OP);
+    my[1] = comb(my[1], rot(y[0], R & 8), OP);
+    x[0] = mx[0];
+    x[1] = mx[1];
+    y[0] = my[0];
+    y[1] = my[1];
+}
+
+// The number of updates until two of the four lanes stay the same over
+// four updates, as in zeroes*.c; imax if the state has not collapsed.
+static inline __attribute__((always_inline))
+uint32_t collapse(uint64_t seed, uint32_t imax, const int MX, const int MY, const int R, const int OP)
+{
+    lane_t x[4];
+    uint64_t s[2] = { rrmxmx(seed), rrmxmx(~seed) };
+    memcpy(x, s, sizeof x);
+    for (uint32_t i = 0; i < imax; i += 4) {
+	lane_t a[4];
+	memcpy(a, x, sizeof a);
+	update(x, x + 2, MX, MY, R, OP);
+	update(x, x + 2, MX, MY, R, OP);
+	update(x, x + 2, MX, MY, R, OP);
+	update(x, x + 2, MX, MY, R, OP);
+	int same = (x[0] == a[0]) + (x[1] == a[1]) + (x[2] == a[2]) + (x[3] == a[3]);
+	if (same >= 2)
+	    return i;
+    }
+    return imax;
+}
+
+#define R16(X, mx, my, op)						\
+    X(mx, my, 0, op) X(mx, my, 1, op) X(mx, my, 2, op) X(mx, my, 3, op)	\
+    X(mx, my, 4, op) X(mx, my, 5, op) X(mx, my, 6, op) X(mx, my, 7, op)	\
+    X(mx, my, 8, op) X(mx, my, 9, op) X(mx, my, 10, op) X(mx, my, 11, op)	\
+    X(mx, my, 12, op) X(mx, my, 13, op) X(mx, my, 14, op) X(mx, my, 15, op)
+#define MY4(X, mx, op)							\
+    R16(X, mx, 0, op) R16(X, mx, 1, op) R16(X, mx, 2, op) R16(X, mx, 3, op)
+#define MX4(X, op)							\
+    MY4(X, 0, op) MY4(X, 1, op) MY4(X, 2, op) MY4(X, 3, op)
+#define VARIANTS(X) MX4(X, 0) MX4(X, 1)
+
+#define DEF(mx, my, r, op)						\
+    static uint32_t collapse_##mx##_##my##_##r##_##op(uint64_t seed, uint32_t imax) \
+    {									\
+	return collapse(seed, imax, mx, my, r, op);			\
+    }
+VARIANTS(DEF)
+
+struct variant {
+    uint32_t (*collapse)(uint64_t seed, uint32_t imax);
+    int mx, my, r, op;
+    uint32_t *t; // the collapse time for each seed
+    uint32_t nt;
+    uint32_t median;
+};
+
+#define ENT(mx, my, r, op) { collapse_##mx##_##my##_##r##_##op, mx, my, r, op, NULL, 0, 0 },
+static struct variant variants[] = { VARIANTS(ENT) };
+#define NVAR (sizeof variants / sizeof *variants)
+
+static struct {
+    int nthr;
+    uint64_t seed0;
+    uint32_t imax;
+    // The variants still in the race, and the seeds for this round.
+    struct variant **v;
+    size_t nv;
+    uint32_t lo, hi;
+    // The work items, (variant, chunk of seeds), go chunk by chunk,
+    // so that the slow variants are not left to the end.
+    size_t next, nitem;
+} G;
+
+#define CHUNK 4
+
+static void *worker(void *arg)
+{
+    while (1) {
+	size_t i = __atomic_fetch_add(&G.next, 1, __ATOMIC_RELAXED);
+	if (i >= G.nitem)
+	    break;
+	struct variant *v = G.v[i % G.nv];
+	uint32_t lo = G.lo + i / G.nv * CHUNK;
+	uint32_t hi = lo + CHUNK < G.hi ? lo + CHUNK : G.hi;
+	for (uint32_t j = lo; j < hi; j++)
+	    v->t[j] = v->collapse(G.seed0 + j, G.imax);
+    }
+    return arg;
+}
+
+static int cmpu32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Better variants first.
+static int cmpvar(const void *a, const void *b)
+{
+    const struct variant *v = *(struct variant **) a, *w = *(struct variant **) b;
+    return (v->median < w->median) - (v->median > w->median);
+}
+
+static void print(const struct variant *v)
+{
+    static const char *mx[] = { "x", "y", "y'", "x'" }, *my[] = { "y", "x", "x'", "y'" };
+    uint32_t censored = 0;
+    for (uint32_t j = 0; j < v->nt; j++)
+	censored += v->t[j] >= G.imax;
+    printf("%s\t%s\t%d%d%d%d\t%c\t%" PRIu32 "%s\t%" PRIu32 "\t%" PRIu32 "\n",
+	    mx[v->mx], my[v->my], v->r & 1, v->r >> 1 & 1, v->r >> 2 & 1, v->r >> 3 & 1,
+	    v->op ? '^' : '+', v->median, v->median >= G.imax ? "+" : "",
+	    v->nt, censored);
+}
+
+int main(int argc, char **argv)
+{
+    G.nthr = 2;
+    G.seed0 = rand64();
+    G.imax = BITS == 8 ? 1 << 24 : 1 << 28;
+    uint32_t nseed = 8;
+    size_t keep = 10;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:n:m:k:")) != -1)
+    switch (opt) {
+    case 'j':
+	G.nthr = atoi(optarg);
+	assert(G.nthr > 0);
+	break;
+    case 's':
+	G.seed0 = strtoull(optarg, NULL, 16);
+	break;
+    case 'n':
+	nseed = atoi(optarg);
+	assert(nseed > 0);
+	break;
+    case 'm':
+	G.imax = strtoul(optarg, NULL, 0);
+	assert(G.imax >= 4);
+	break;
+    case 'k':
+	keep = atoi(optarg);
+	assert(keep > 0);
+	break;
+    default:
+	assert(!!!"getopt");
+    }
+    assert(optind == argc);
+
+    G.v = malloc(NVAR * sizeof *G.v);
+    assert(G.v);
+    for (size_t i = 0; i < NVAR; i++)
+	G.v[i] = &variants[i];
+    G.nv = NVAR;
+    pthread_t tid[G.nthr];
+    for (int round = 0; ; round++) {
+	G.lo = G.hi, G.hi += nseed << round;
+	for (size_t i = 0; i < G.nv; i++) {
+	    G.v[i]->t = realloc(G.v[i]->t, G.hi * sizeof(uint32_t));
+	    assert(G.v[i]->t);
+	}
+	G.nitem = G.nv * ((G.hi - G.lo + CHUNK - 1) / CHUNK);
+	G.next = 0;
+	for (int i = 0; i < G.nthr; i++) {
+	    int rc = pthread_create(&tid[i], NULL, worker, NULL);
+	    assert(rc == 0);
+	}
+	for (int i = 0; i < G.nthr; i++) {
+	    int rc = pthread_join(tid[i], NULL);
+	    assert(rc == 0);
+	}
+	for (size_t i = 0; i < G.nv; i++) {
+	    struct variant *v = G.v[i];
+	    v->nt = G.hi;
+	    uint32_t *t = malloc(v->nt * sizeof *t);
+	    assert(t);
+	    memcpy(t, v->t, v->nt * sizeof *t);
+	    qsort(t, v->nt, sizeof *t, cmpu32);
+	    v->median = t[v->nt / 2];
+	    free(t);
+	}
+	qsort(G.v, G.nv, sizeof *G.v, cmpvar);
+	fprintf(stderr, "# round %d: %zu variants, %" PRIu32 " seeds, best median %" PRIu32 "\n",
+		round, G.nv, G.hi, G.v[0]->median);
+	if (G.nv <= keep)
+	    break;
+	G.nv = G.nv / 2 > keep ? G.nv / 2 : keep;
+    }
+    printf("# MX\tMY\tR\tOP\tmedian\tseeds\tcensored\n");
+    for (size_t i = 0; i < G.nv; i++)
+	print(G.v[i]);
+    return 0;
+}